@@ -35,6 +35,10 @@ include_directories (${MongoDB_INCLUDE_DIRS})
 find_package (Pthread REQUIRED)
 include_directories (${Pthread_INCLUDE_DIRS})
 
+# Configure zlib for MODE Z transfers
+find_package (ZLIB REQUIRED)
+include_directories (${ZLIB_INCLUDE_DIRS})
+
 # Some OSes seem to use external libexecinfo
 find_package (Execinfo REQUIRED)
 include_directories(${Execinfo_INCLUDE_DIRS})
@@ -50,6 +54,7 @@ list(APPEND ALL_LIBRARIES
   ${MongoDB_LIBRARIES}
   ${OPENSSL_LIBRARIES}
   ${Boost_LIBRARIES}
+  ${ZLIB_LIBRARIES}
   ${Execinfo_LIBRARIES}
   ${Pthread_LIBRARIES}
   rt
@@ -1,3 +1,4 @@
+#include <limits>
 #include <iostream>
 #include <fstream>
 #include <boost/lexical_cast.hpp>
@@ -60,6 +61,11 @@ Config::Config(const std::string& configPath, bool tool) :
   sitenameShort("EB"),
   datapath("data"),
   bouncerOnly(false),
+  listenSockets(0),
+  tcpDeferAccept(0),
+  maxPending(0),
+  sessionThreads(64),
+  pasvPool(0),
   securityLog("security", true, true, 0),
   databaseLog("database", true, true, 0),
   eventLog("events", true, true, 0),
@@ -77,8 +83,15 @@ Config::Config(const std::string& configPath, bool tool) :
   maximumRatio(10),
   dirSizeDepth(2),
   asyncCRC(false),
+  transferBufferMinimum(ParseSize("16K") * 1024),
+  transferBufferMaximum(ParseSize("4M") * 1024),
+  socketBuffer(0),
+  modeZLevel(6),
   identLookup(true),
   dnsLookup(true),
+  lookupTimeout(5),
+  lookupCacheTTL(600),
+  lookupFailedTTL(60),
   logAddresses(cfg::LogAddresses::Always),
   umask(fs::CurrentUmask()),
   defaultLogLines(100),
@@ -298,6 +311,11 @@ void Config::ParseGlobal(const std::string& opt, std::vector<std::string>& toks)
     ParameterCheck(opt, toks, 1, -1);
     calcCrc.insert(calcCrc.end(), toks.begin(), toks.end());
   }
+  else if (opt == "preallocate")
+  {
+    ParameterCheck(opt, toks, 2, -1);
+    preallocate.emplace_back(toks);
+  }
   else if (opt == "xdupe")
   {
     ParameterCheck(opt, toks, 1, -1);
@@ -308,6 +326,35 @@ void Config::ParseGlobal(const std::string& opt, std::vector<std::string>& toks)
     ParameterCheck(opt, toks, 1, -1);
     validIp.insert(validIp.end(), toks.begin(), toks.end());
   }
+  else if (opt == "listen_sockets")
+  {
+    ParameterCheck(opt, toks, 1);
+    listenSockets = boost::lexical_cast<int>(toks[0]);
+    if (listenSockets < 0) throw boost::bad_lexical_cast();
+  }
+  else if (opt == "tcp_defer_accept")
+  {
+    ParameterCheck(opt, toks, 1);
+    tcpDeferAccept = boost::lexical_cast<int>(toks[0]);
+    if (tcpDeferAccept < 0) throw boost::bad_lexical_cast();
+  }
+  else if (opt == "max_pending")
+  {
+    ParameterCheck(opt, toks, 1);
+    maxPending = boost::lexical_cast<int>(toks[0]);
+    if (maxPending < 0) throw boost::bad_lexical_cast();
+  }
+  else if (opt == "connection_rate")
+  {
+    ParameterCheck(opt, toks, 3);
+    connectionRate = ::cfg::ConnectionRate(toks);
+  }
+  else if (opt == "session_threads")
+  {
+    ParameterCheck(opt, toks, 1);
+    sessionThreads = boost::lexical_cast<int>(toks[0]);
+    if (sessionThreads < 0) throw boost::bad_lexical_cast();
+  }
   else if (opt == "active_addr")
   {
     ParameterCheck(opt, toks, 1, -1);
@@ -368,6 +415,12 @@ void Config::ParseGlobal(const std::string& opt, std::vector<std::string>& toks)
   {
     pasvPorts = Ports(toks);
   }
+  else if (opt == "pasv_pool")
+  {
+    ParameterCheck(opt, toks, 1);
+    pasvPool = boost::lexical_cast<int>(toks[0]);
+    if (pasvPool < 0) throw boost::bad_lexical_cast();
+  }
   else if (opt == "allow_fxp")
   {
     ParameterCheck(opt, toks, 4, -1);
@@ -542,6 +595,7 @@ void Config::ParseGlobal(const std::string& opt, std::vector<std::string>& toks)
   {
     ParameterCheck(opt, toks, 3);
     cscript.emplace_back(toks);
+    cscriptIndex[cscript.back().Command()].emplace_back(cscript.size() - 1);
   }
   else if (opt == "lslong")
   {
@@ -582,6 +636,7 @@ void Config::ParseGlobal(const std::string& opt, std::vector<std::string>& toks)
   {
     ParameterCheck(opt, toks, 4, 5);
     siteCmd.emplace_back(toks);
+    siteCmdIndex.insert(std::make_pair(siteCmd.back().Command(), siteCmd.size() - 1));
   }
   else if (opt == "idle_timeout")
   {
@@ -645,6 +700,28 @@ void Config::ParseGlobal(const std::string& opt, std::vector<std::string>& toks)
     ParameterCheck(opt, toks, 1);
     asyncCRC = YesNoToBoolean(toks[0]);
   }
+  else if (opt == "transfer_buffer")
+  {
+    ParameterCheck(opt, toks, 2);
+    transferBufferMinimum = ParseSize(toks[0]) * 1024;
+    transferBufferMaximum = ParseSize(toks[1]) * 1024;
+    if (transferBufferMinimum < 4096 || 
+        transferBufferMaximum < transferBufferMinimum)
+      throw boost::bad_lexical_cast();
+  }
+  else if (opt == "socket_buffer")
+  {
+    ParameterCheck(opt, toks, 1);
+    long long size = ParseSize(toks[0]) * 1024;
+    if (size < 0 || size > std::numeric_limits<int>::max()) throw boost::bad_lexical_cast();
+    socketBuffer = size;
+  }
+  else if (opt == "mode_z_level")
+  {
+    ParameterCheck(opt, toks, 1);
+    modeZLevel = boost::lexical_cast<int>(toks[0]);
+    if (modeZLevel < 1 || modeZLevel > 9) throw boost::bad_lexical_cast();
+  }
   else if (opt == "ident_lookup")
   {
     ParameterCheck(opt, toks, 1);
@@ -655,6 +732,19 @@ void Config::ParseGlobal(const std::string& opt, std::vector<std::string>& toks)
     ParameterCheck(opt, toks, 1);
     dnsLookup = YesNoToBoolean(toks[0]);
   }
+  else if (opt == "lookup_timeout")
+  {
+    ParameterCheck(opt, toks, 1);
+    lookupTimeout = boost::lexical_cast<int>(toks[0]);
+    if (lookupTimeout < 1) throw boost::bad_lexical_cast();
+  }
+  else if (opt == "lookup_cache")
+  {
+    ParameterCheck(opt, toks, 2);
+    lookupCacheTTL = boost::lexical_cast<int>(toks[0]);
+    lookupFailedTTL = boost::lexical_cast<int>(toks[1]);
+    if (lookupCacheTTL < 0 || lookupFailedTTL < 0) throw boost::bad_lexical_cast();
+  }
   else if (opt == "log_addresses")
   {
     ParameterCheck(opt, toks, 1);
@@ -719,6 +809,21 @@ void Config::ParseSection(const std::string& opt, std::vector<std::string>& toks
     currentSection->ratio = boost::lexical_cast<int>(toks[0]);
     if (currentSection->ratio < 0) throw boost::bad_lexical_cast();
   }
+  else if (opt == "read_ahead")
+  {
+    ParameterCheck(opt, toks, 1);
+    currentSection->readAhead = ParseSize(toks[0]) * 1024;
+  }
+  else if (opt == "drop_behind")
+  {
+    ParameterCheck(opt, toks, 1);
+    currentSection->dropBehind = ParseSize(toks[0]) * 1024;
+  }
+  else if (opt == "mode_z")
+  {
+    ParameterCheck(opt, toks, 1);
+    currentSection->modeZ = YesNoToBoolean(toks[0]);
+  }
   else if (opt == "endsection")
   {
     currentSection = nullptr;
@@ -799,6 +904,27 @@ boost::optional<const Section&> Config::SectionMatch(const std::string& path) co
   return boost::optional<const Section&>();
 }
 
+bool Config::ModeZAllowed(const std::string& path) const
+{
+  auto section = SectionMatch(path);
+  return !section || section->ModeZ();
+}
+
+// positions in Cscript() of the cscripts for a command, so commands
+// without any don't have to look through them all
+const std::vector<size_t>& Config::CscriptIndex(const std::string& command) const
+{
+  static const std::vector<size_t> none;
+  auto it = cscriptIndex.find(command);
+  return it == cscriptIndex.end() ? none : it->second;
+}
+
+const ::cfg::SiteCmd* Config::SiteCmd(const std::string& command) const
+{
+  auto it = siteCmdIndex.find(command);
+  return it == siteCmdIndex.end() ? nullptr : &siteCmd[it->second];
+}
+
 ConfigPtr Config::Load(std::string configPath, bool tool)
 {
   std::vector<std::string> configPaths;
@@ -64,12 +64,19 @@ class Config
   std::vector<SpeedLimit> minimumSpeed;
   ::cfg::SimXfers simXfers;
   std::vector<std::string> calcCrc;
+  std::vector< ::cfg::Preallocate> preallocate;
   std::vector<std::string> xdupe;
   std::vector<std::string> validIp;
+  int listenSockets;
+  int tcpDeferAccept;
+  int maxPending;
+  ::cfg::ConnectionRate connectionRate;
+  int sessionThreads;
   std::vector<std::string> activeAddr;
   std::vector<std::string> pasvAddr;
   Ports activePorts;
   Ports pasvPorts;
+  int pasvPool;
   std::vector< ::cfg::AllowFxp> allowFxp;
   std::vector< ::cfg::Right> welcomeMsg;
   std::vector< ::cfg::Right> goodbyeMsg;
@@ -121,6 +128,7 @@ class Config
   std::vector< ::cfg::Right> showDiz;
   bool dlIncomplete;
   std::vector< ::cfg::Cscript> cscript;
+  std::unordered_map<std::string, std::vector<size_t>> cscriptIndex;
   std::vector<std::string> idleCommands;
   int totalUsers;
   ::cfg::Lslong lslong;
@@ -134,6 +142,7 @@ class Config
   std::vector< ::cfg::Msgpath> msgpath;
   std::vector< ::cfg::Privpath> privpath;
   std::vector< ::cfg::SiteCmd> siteCmd;
+  std::unordered_map<std::string, size_t> siteCmdIndex;
   int maxSitecmdLines;
   ::cfg::IdleTimeout idleTimeout;
   ::cfg::Database database;
@@ -147,8 +156,15 @@ class Config
   int maximumRatio;
   int dirSizeDepth;
   bool asyncCRC;
+  long long transferBufferMinimum;
+  long long transferBufferMaximum;
+  int socketBuffer;
+  int modeZLevel;
   bool identLookup;
   bool dnsLookup;
+  int lookupTimeout;
+  int lookupCacheTTL;
+  int lookupFailedTTL;
   ::cfg::LogAddresses logAddresses;
   mode_t umask;
   int defaultLogLines;
@@ -210,12 +226,19 @@ public:
   const std::vector<SpeedLimit>& MinimumSpeed() const { return minimumSpeed; }
   const ::cfg::SimXfers& SimXfers() const { return simXfers; }
   const std::vector<std::string>& CalcCrc() const { return calcCrc; }
+  const std::vector< ::cfg::Preallocate>& Preallocate() const { return preallocate; }
   const std::vector<std::string>& Xdupe() const { return xdupe; }
   const std::vector<std::string>& ValidIp() const { return validIp; }
+  int ListenSockets() const { return listenSockets; }
+  int TCPDeferAccept() const { return tcpDeferAccept; }
+  int MaxPending() const { return maxPending; }
+  const ::cfg::ConnectionRate& ConnectionRate() const { return connectionRate; }
+  int SessionThreads() const { return sessionThreads; }
   const std::vector<std::string>& ActiveAddr() const { return activeAddr; }
   const std::vector<std::string>& PasvAddr() const { return pasvAddr; }
   const Ports& ActivePorts() const { return activePorts; }
   const Ports& PasvPorts() const { return pasvPorts; }
+  int PasvPool() const { return pasvPool; }
   const std::vector< ::cfg::AllowFxp>& AllowFxp() const { return allowFxp; }
   const std::vector< ::cfg::Right>& WelcomeMsg() const { return welcomeMsg; }
   const std::vector< ::cfg::Right>& GoodbyeMsg() const { return goodbyeMsg; }
@@ -288,6 +311,9 @@ public:
   const std::vector<CheckScript>& PostCheck() const { return postCheck; }  
   const std::map<std::string, Section>& Sections() const { return sections; }
   boost::optional<const Section&> SectionMatch(const std::string& path) const;
+  bool ModeZAllowed(const std::string& path) const;
+  const std::vector<size_t>& CscriptIndex(const std::string& command) const;
+  const ::cfg::SiteCmd* SiteCmd(const std::string& command) const;
   ::cfg::EPSVFxp EPSVFxp() const { return epsvFxp; }
   int MaximumRatio() const { return maximumRatio; }
   const acl::ACL& TLSControl() const { return tlsControl; }
@@ -296,8 +322,15 @@ public:
   const acl::ACL& TLSFxp() const { return tlsFxp; }
   int DirSizeDepth() const { return dirSizeDepth; }
   bool AsyncCRC() const { return asyncCRC; }
+  long long TransferBufferMinimum() const { return transferBufferMinimum; }
+  long long TransferBufferMaximum() const { return transferBufferMaximum; }
+  int SocketBuffer() const { return socketBuffer; }
+  int ModeZLevel() const { return modeZLevel; }
   bool IdentLookup() const { return identLookup; }
   bool DNSLookup() const { return dnsLookup; }
+  int LookupTimeout() const { return lookupTimeout; }
+  int LookupCacheTTL() const { return lookupCacheTTL; }
+  int LookupFailedTTL() const { return lookupFailedTTL; }
   ::cfg::LogAddresses LogAddresses() const { return logAddresses; }
   mode_t Umask() const { return umask; }
   int DefaultLogLines() const { return defaultLogLines; }
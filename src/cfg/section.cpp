@@ -4,6 +4,8 @@
 namespace cfg
 {
 
+const long long Section::defaultReadAhead;
+
 bool Section::IsMatch(const std::string& path) const
 {
   for (const auto& p : paths)
@@ -18,18 +18,29 @@ class Section
   std::vector<std::string> paths;
   bool separateCredits;
   int ratio;
+  long long readAhead;
+  long long dropBehind;
+  bool modeZ;
 
 public:
+  static const long long defaultReadAhead = 1024 * 1024;
+
   Section(const std::string& name) :
     name(name),
     separateCredits(false),
-    ratio(-1)
+    ratio(-1),
+    readAhead(defaultReadAhead),
+    dropBehind(0),
+    modeZ(true)
   { }
   
   const std::string& Name() const { return name; }
   bool IsMatch(const std::string& path) const;
   bool SeparateCredits() const { return separateCredits; }
   int Ratio() const { return ratio; }
+  long long ReadAhead() const { return readAhead; }
+  long long DropBehind() const { return dropBehind; }
+  bool ModeZ() const { return modeZ; }
   
   friend class Config;
 };
@@ -87,6 +87,30 @@ bool AsciiUploads::Allowed(const std::string& path) const
   return false;
 }
 
+Preallocate::Preallocate(const std::vector<std::string>& toks) :
+  kBytes(ParseSize(toks[0])),
+  masks(toks.begin() + 1, toks.end())
+{
+  if (kBytes <= 0) throw boost::bad_lexical_cast();
+}
+
+bool Preallocate::Matches(const std::string& path) const
+{
+  for (auto& mask : masks)
+  {
+    if (util::WildcardMatch(mask, path)) return true;
+  }
+  return false;
+}
+
+ConnectionRate::ConnectionRate(const std::vector<std::string>& toks)
+{
+  perAddress = boost::lexical_cast<int>(toks[0]);
+  perSubnet = boost::lexical_cast<int>(toks[1]);
+  seconds = boost::lexical_cast<int>(toks[2]);
+  if (perAddress < 0 || perSubnet < 0 || seconds < 1) throw boost::bad_lexical_cast();
+}
+
 SecureIp::SecureIp(std::vector<std::string> toks)
 {
   int numOctets = boost::lexical_cast<int>(toks[0]);
@@ -88,6 +88,31 @@ public:
   bool Allowed(const std::string& path) const;
 };
 
+class Preallocate
+{
+  long long kBytes;
+  std::vector<std::string> masks;
+  
+public:
+  Preallocate(const std::vector<std::string>& toks);
+  long long KBytes() const { return kBytes; }
+  bool Matches(const std::string& path) const;
+};
+
+class ConnectionRate
+{
+  int perAddress;
+  int perSubnet;
+  int seconds;
+  
+public:
+  ConnectionRate() : perAddress(0), perSubnet(0), seconds(1) { }
+  ConnectionRate(const std::vector<std::string>& toks);
+  int PerAddress() const { return perAddress; }
+  int PerSubnet() const { return perSubnet; }
+  int Seconds() const { return seconds; }
+};
+
 class SecureIp
 {
   acl::IPStrength strength;
@@ -129,8 +154,8 @@ class SpeedLimit
 public:
   SpeedLimit(std::vector<std::string> toks);
   const std::string& Path() const { return path; }
-  long long Uploads() const { return downloads; }
-  long long Downloads() const { return uploads; }
+  long long Uploads() const { return uploads; }
+  long long Downloads() const { return downloads; }
   const acl::ACL& ACL() const { return acl; }
 };
 
@@ -16,11 +16,7 @@ std::string CompileWhosOnline(const std::string& id, text::Template& templ)
   
   {
     ftp::OnlineReader reader(id);  
-    
-    {
-      ftp::OnlineReaderLock lock(reader);
-      std::copy(reader.begin(), reader.end(), std::back_inserter(clients));
-    }
+    std::copy(reader.begin(), reader.end(), std::back_inserter(clients));
   }
   
   std::ostringstream multiStr;
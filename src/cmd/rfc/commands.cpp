@@ -45,6 +45,43 @@ void ABORCommand::Execute()
   return;
 }
 
+void ALLOCommand::Execute()
+{
+  if (args.size() == 3) throw cmd::SyntaxError();
+  if (args.size() == 4)
+  {
+    // record size is meaningless for our file structure, but must be valid
+    util::ToUpper(args[2]);
+    if (args[2] != "R") throw cmd::SyntaxError();
+  }
+  
+  off_t size;
+  try
+  {
+    size = boost::lexical_cast<off_t>(args[1]);
+    if (size < 0) throw boost::bad_lexical_cast();
+    if (args.size() == 4 && boost::lexical_cast<off_t>(args[3]) < 0)
+      throw boost::bad_lexical_cast();
+  }
+  catch (const boost::bad_lexical_cast&)
+  {
+    control.Reply(ftp::SyntaxError, "Invalid allocation size.");
+    return;
+  }
+  
+  data.SetAllocateSize(size);
+  
+  if (size == 0)
+  {
+    control.Reply(ftp::CommandSuperfluous, "No storage allocation necessary.");
+    return;
+  }
+  
+  std::ostringstream os;
+  os << size << " bytes will be reserved for the next upload.";
+  control.Reply(ftp::CommandOkay, os.str());
+}
+
 void AUTHCommand::Execute()
 {
   if (!util::net::TLSServerContext::Get())
@@ -248,6 +285,7 @@ void FEATCommand::Execute()
   control.PartReply(ftp::NoCode, " SSCN");
   control.PartReply(ftp::NoCode, " CPSV");
   control.PartReply(ftp::NoCode, " MFMT");
+  control.PartReply(ftp::NoCode, " MODE Z");
   control.Reply(ftp::SystemStatus, "End.");
 
   (void) singleLineReplies;
@@ -268,7 +306,7 @@ void HELPCommand::Execute()
   static const char* reply =
     " ebftpd Command listing:\n"
     "------------------------------------------------------------------\n"
-    " ABOR *ACCT *ADAT *ALLO  APPE  AUTH *CCC   CDUP *CONF  CWD   DELE\n"
+    " ABOR *ACCT *ADAT  ALLO  APPE  AUTH *CCC   CDUP *CONF  CWD   DELE\n"
     "*ENC   EPRT  EPSV  FEAT  HELP *LANG  LIST *LPRT *LPSV  MDTM *MIC\n"
     " MKD  *MLSD *MLST  MODE  NLST  NOOP *OPTS  PASS  PASV  PBSZ  PORT\n"
     " PROT  PWD   QUIT *REIN *REST  RETR  RMD   RNFR  RNTO  SITE  SIZE\n"
@@ -282,6 +320,27 @@ void HELPCommand::Execute()
 
 void LISTCommand::Execute()
 {
+  std::string options;
+  fs::Path path;
+  if (args.size() >= 2)
+  {
+    std::string::size_type optOffset = 0;
+    if (args[1][0] == '-')
+    {
+      options = args[1].substr(1);
+      optOffset += args[1].length();
+    }
+    
+    path = fs::Path(util::TrimCopy(std::string(argStr, optOffset)));
+  }
+  
+  if (data.TransferMode() == ftp::TransferMode::Deflate &&
+      !cfg::Get().ModeZAllowed(fs::MakeVirtual(path).ToString()))
+  {
+    control.Reply(ftp::ActionNotOkay, "MODE Z not allowed here, change to MODE S.");
+    return;
+  }
+  
   std::ostringstream os;
   os << "Opening connection for directory listing";
   if (data.Protection()) os << " using TLS/SSL";
@@ -306,20 +365,6 @@ void LISTCommand::Execute()
     return;
   }
 
-  std::string options;
-  fs::Path path;
-  if (args.size() >= 2)
-  {
-    std::string::size_type optOffset = 0;
-    if (args[1][0] == '-')
-    {
-      options = args[1].substr(1);
-      optOffset += args[1].length();
-    }
-    
-    path = fs::Path(util::TrimCopy(std::string(argStr, optOffset)));
-  }
-  
   const cfg::Config& config = cfg::Get();
   std::string forcedOptions(nlst ? "" : "l" + config.Lslong().Options());
   
@@ -529,8 +574,17 @@ void MKDCommand::Execute()
 
 void MODECommand::Execute()
 {
+  util::ToUpper(args[1]);
   if (args[1] == "S")
+  {
+    data.SetTransferMode(ftp::TransferMode::Stream);
     control.Reply(ftp::CommandOkay, "Transfer mode set to 'stream'.");
+  }
+  else if (args[1] == "Z")
+  {
+    data.SetTransferMode(ftp::TransferMode::Deflate);
+    control.Reply(ftp::CommandOkay, "Transfer mode set to 'deflate'.");
+  }
   else if (args[1] == "B")
     control.Reply(ftp::ParameterNotImplemented,
                  "Transfer mode 'block' not implemented.");
@@ -20,8 +20,8 @@ Factory::Factory()
                   nullptr, "NOT IMPLEMENTED" }, },
     { "ADAT",   { 0,  -1, ftp::ClientState::AnyState,         ftp::ActionNotOkay,
                   nullptr, "NOT IMPLEMENTED" }, },
-    { "ALLO",   { 0,  -1, ftp::ClientState::AnyState,         ftp::ActionNotOkay,
-                  nullptr, "NOT IMPLEMENTED" }, },
+    { "ALLO",   { 1,  3,  ftp::ClientState::LoggedIn,         ftp::ActionNotOkay,
+                  std::make_shared<Creator<ALLOCommand>>(), "ALLO <size> [R <record size>]" }, },
     { "APPE",   { 0,  -1, ftp::ClientState::AnyState,         ftp::ActionNotOkay,
                   nullptr, "NOT IMPLEMENTED" }, },
     { "AUTH",   { 1,  1,  ftp::ClientState::LoggedOut,        ftp::ActionNotOkay,
@@ -127,10 +127,20 @@ Factory::Factory()
     { "USER",   { 1, -1,  ftp::ClientState::LoggedOut,        ftp::ActionNotOkay,
                   std::make_shared<Creator<USERCommand>>(), "USER <user>" }, }
   };
+  
+  index.Build(defs);
 }
 
 CommandDefOptRef Factory::Lookup(const std::string& command)
 {
+  uint64_t key = VerbIndex<CommandDef>::Pack(command);
+  if (key)
+  {
+    const CommandDef* def = factory->index.Find(key);
+    if (def) return CommandDefOptRef(*def);
+    return CommandDefOptRef();
+  }
+  
   CommandDefMap::const_iterator it = factory->defs.find(command);
   if (it != factory->defs.end()) return CommandDefOptRef(it->second);
   return CommandDefOptRef();
@@ -4,6 +4,7 @@
 #include <memory>
 #include <unordered_map>
 #include "cmd/command.hpp"
+#include "cmd/verbindex.hpp"
 #include "ftp/client.hpp"
 #include "ftp/replycodes.hpp"
 
@@ -81,6 +82,7 @@ public:
 
 private:                            
   CommandDefMap defs;
+  VerbIndex<CommandDef> index;
    
   Factory();
   
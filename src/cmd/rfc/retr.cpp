@@ -1,8 +1,11 @@
 #include <ios>
+#include <cerrno>
+#include <algorithm>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/logic/tribool.hpp>
 #include "cmd/rfc/retr.hpp"
 #include "fs/file.hpp"
+#include "fs/readahead.hpp"
 #include "db/stats/stats.hpp"
 #include "stats/util.hpp"
 #include "util/scopeguard.hpp"
@@ -22,10 +25,18 @@
 #include "stats/types.hpp"
 #include "stats/stat.hpp"
 #include "ftp/online.hpp"
+#include "ftp/transferbuffer.hpp"
 
 namespace cmd { namespace rfc
 {
 
+namespace
+{
+// small enough that speed limiting, abort and
+// online updates remain responsive between calls
+const size_t sendFileChunk = 65536;
+}
+
 boost::tribool CheckWeeklyAllotment(const acl::User& user, const std::string& section, off_t size)
 {
   long long allotment = user.SectionWeeklyAllotment(section);
@@ -111,6 +122,13 @@ void RETRCommand::Execute()
     throw cmd::NoPostScriptError();
   }
   
+  if (data.TransferMode() == ftp::TransferMode::Deflate &&
+      !cfg::Get().ModeZAllowed(path.ToString()))
+  {
+    control.Reply(ftp::ActionNotOkay, "MODE Z not allowed here, change to MODE S.");
+    throw cmd::NoPostScriptError();
+  }
+  
   int ratio = -1;
   auto section = cfg::Get().SectionMatch(path.ToString());
   boost::tribool allotment = CheckWeeklyAllotment(client.User(), section ? section->Name() : "", size);
@@ -202,16 +220,44 @@ void RETRCommand::Execute()
   try
   {
     ftp::DownloadSpeedControl speedControl(client, path);
-    ftp::OnlineTransferUpdater onlineUpdater(boost::this_thread::get_id(), stats::Direction::Download,
+    ftp::OnlineTransferUpdater onlineUpdater(client, stats::Direction::Download,
                                              data.State().StartTime());
     
     bool dlIncomplete = cfg::Get().DlIncomplete();
     std::vector<char> asciiBuf;
-    char buffer[16384];
+    ftp::TransferBuffer buffer(data);
+    
+    bool sendFile = data.CanSendFile();
+    off_t sendOffset = offset;
+    
+    fs::ReadAhead readAhead(fin->handle(), offset, 
+                            section ? section->ReadAhead() : cfg::Section::defaultReadAhead,
+                            section && section->DropBehind() > 0 && size >= section->DropBehind());
     
     while (true)
     {
-      std::streamsize len = fin->read(buffer, sizeof(buffer));
+      std::streamsize len;
+      if (sendFile)
+      {
+        try
+        {
+          len = data.SendFile(fin->handle(), sendOffset, speedControl.Allowance(
+                                std::max(sendFileChunk, buffer.Size())));
+          if (!len) len = -1;
+        }
+        catch (const util::net::NetworkSystemError& e)
+        {
+          // file is on a filesystem that doesn't support sendfile
+          if (sendOffset != offset || (e.Errno() != EINVAL && e.Errno() != ENOSYS)) throw;
+          sendFile = false;
+          continue;
+        }
+      }
+      else
+      {
+        len = fin->read(buffer.Get(), speedControl.Allowance(buffer.Size()));
+      }
+      
       if (len < 0) 
       {
         if (!dlIncomplete || !fs::IsIncomplete(MakeReal(path))) break;
@@ -220,19 +266,23 @@ void RETRCommand::Execute()
       }
       
       data.State().Update(len);
+      readAhead.Advance(offset + data.State().Bytes());
       
-      char *bufp = buffer;
-      if (data.DataType() == ftp::DataType::ASCII)
+      if (!sendFile)
       {
-        ftp::ASCIITranscodeRETR(buffer, len, asciiBuf);
-        len = asciiBuf.size();
-        bufp = asciiBuf.data();
+        char *bufp = buffer.Get();
+        if (data.DataType() == ftp::DataType::ASCII)
+        {
+          len = ftp::ASCIITranscodeRETR(buffer.Get(), len, asciiBuf);
+          bufp = asciiBuf.data();
+        }
+        
+        data.Write(bufp, len);
       }
-      
-      data.Write(bufp, len);
 
       onlineUpdater.Update(data.State().Bytes());
-      speedControl.Apply();
+      speedControl.Apply(len);
+      buffer.Adapt();
     }
   }
   catch (const ftp::TransferAborted&) { aborted = true; }
@@ -1,5 +1,8 @@
 #include <ios>
+#include <cerrno>
+#include <algorithm>
 #include <unistd.h>
+#include <fcntl.h>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include "cmd/rfc/stor.hpp"
 #include "fs/file.hpp"
@@ -18,6 +21,7 @@
 #include "cmd/error.hpp"
 #include "fs/owner.hpp"
 #include "util/asynccrc32.hpp"
+#include "util/asyncwriter.hpp"
 #include "util/crc32.hpp"
 #include "ftp/error.hpp"
 #include "acl/misc.hpp"
@@ -26,6 +30,7 @@
 #include "acl/flags.hpp"
 #include "ftp/xdupe.hpp"
 #include "ftp/online.hpp"
+#include "ftp/transferbuffer.hpp"
 
 namespace cmd { namespace rfc
 {
@@ -48,6 +53,41 @@ std::string FileAge(const fs::RealPath& path)
   return std::string("");
 }
 
+// moves len bytes already spliced into the pipe on to the file,
+// returns false if the file's filesystem doesn't support splice
+bool SpliceToFile(int pipeFd, int fd, size_t& len)
+{
+  while (len > 0)
+  {
+    ssize_t result = splice(pipeFd, nullptr, fd, nullptr, len, SPLICE_F_MOVE);
+    if (result < 0)
+    {
+      if (errno == EINTR) continue;
+      if (errno == EINVAL) return false;
+      throw std::ios_base::failure(util::ErrnoToMessage(errno));
+    }
+    len -= result;
+  }
+  
+  return true;
+}
+
+void DrainPipe(int pipeFd, fs::FileSink& fout, size_t len)
+{
+  char buffer[16384];
+  while (len > 0)
+  {
+    ssize_t result = read(pipeFd, buffer, std::min(len, sizeof(buffer)));
+    if (result < 0)
+    {
+      if (errno == EINTR) continue;
+      throw std::ios_base::failure(util::ErrnoToMessage(errno));
+    }
+    fout.write(buffer, result);
+    len -= result;
+  }
+}
+
 }
 
 void STORCommand::DupeMessage(const fs::VirtualPath& path)
@@ -93,11 +133,27 @@ bool STORCommand::CalcCRC(const fs::VirtualPath& path)
   return false;
 }
 
+off_t STORCommand::PreallocateSize(const fs::VirtualPath& path)
+{
+  if (data.AllocateSize() > 0) return data.AllocateSize();
+  
+  for (auto& preallocate : cfg::Get().Preallocate())
+  {
+    if (preallocate.Matches(path.ToString())) return preallocate.KBytes() * 1024;
+  }
+  
+  return 0;
+}
+
 void STORCommand::Execute()
 {
   namespace pt = boost::posix_time;
   namespace gd = boost::gregorian;
   
+  // ALLO only applies to the next STOR, whether or not it gets far
+  // enough to open the data connection
+  auto allocateGuard = util::MakeScopeExit([&]{ data.SetAllocateSize(0); });
+  
   fs::VirtualPath path(fs::PathFromUser(argStr));
   
   util::Error e(acl::path::Filter(client.User(), path.Basename()));
@@ -147,13 +203,22 @@ void STORCommand::Execute()
     throw cmd::NoPostScriptError();
   }
   
+  if (data.TransferMode() == ftp::TransferMode::Deflate &&
+      !cfg::Get().ModeZAllowed(path.ToString()))
+  {
+    control.Reply(ftp::ActionNotOkay, "MODE Z not allowed here, change to MODE S.");
+    throw cmd::NoPostScriptError();
+  }
+  
+  // sizes are for the whole file, a resumed upload only needs the rest
+  off_t allocate = std::max<off_t>(0, PreallocateSize(path) - data.RestartOffset());
   fs::FileSinkPtr fout;
   try
   {
     if (data.RestartOffset() > 0)
-      fout = fs::AppendFile(client.User(), path, data.RestartOffset());
+      fout = fs::AppendFile(client.User(), path, data.RestartOffset(), allocate);
     else
-      fout = fs::CreateFile(client.User(), path);
+      fout = fs::CreateFile(client.User(), path, allocate);
   }
   catch (const util::SystemError& e)
   {
@@ -195,6 +260,29 @@ void STORCommand::Execute()
     }
   });  
   
+  bool preallocated = false;
+  if (allocate > 0)
+  {
+    e = fs::Preallocate(fout->handle(), data.RestartOffset(), allocate);
+    if (e) preallocated = true;
+    else if (e.Errno() == ENOSPC)
+    {
+      control.Reply(ftp::NoDiskFree, "Unable to reserve space for upload: " + e.Message());
+      throw cmd::NoPostScriptError();
+    }
+    else
+    {
+      // not all filesystems support it, upload continues without reservation
+      logs::Debug("Unable to preallocate %1% bytes for upload: %2%", allocate, e.Message());
+    }
+  }
+  
+  // release whatever the upload didn't use if it comes up short
+  auto trimGuard = util::MakeScopeExit([&]
+  {
+    if (preallocated && fout->is_open()) fs::TrimPreallocated(fout->handle());
+  });
+  
   std::stringstream os;
   os << "Opening " << (data.DataType() == ftp::DataType::ASCII ? "ASCII" : "BINARY") 
      << " connection for upload of " 
@@ -250,41 +338,105 @@ void STORCommand::Execute()
       }
   });
   
-  static const size_t bufferSize = 16384;
+  static const size_t spliceChunk = 65536;
+  static const unsigned writeQueueSize = 4;
+  static const unsigned crcQueueSize = 4;
   bool calcCrc = CalcCRC(path);
-  std::unique_ptr<util::CRC32> crc32(cfg::Get().AsyncCRC() ? 
-                                     new util::AsyncCRC32(bufferSize, 10) :
-                                     new util::CRC32());
+  bool ascii = data.DataType() == ftp::DataType::ASCII;
   bool aborted = false;
   fileOkay = false;
   
+  // binary data is gathered into full buffers and written to disk
+  // while the next buffer is being received, the writer is only started
+  // once we know the buffered binary path is being used
+  ftp::TransferBuffer buffer(data);
+  size_t buffered = 0;
+  std::unique_ptr<util::AsyncWriter> writer;
+  auto startWriter = [&]()
+  {
+    if (!ascii && !writer) writer.reset(new util::AsyncWriter(fout->handle(), writeQueueSize));
+  };
+  
+  // async crc takes over whole buffers, binary ones are passed on
+  // to the writer once checksummed, crc uploads never splice
+  util::AsyncCRC32* asyncCrc = nullptr;
+  std::unique_ptr<util::CRC32> crc32;
+  if (calcCrc && cfg::Get().AsyncCRC())
+  {
+    startWriter();
+    crc32.reset(asyncCrc = new util::AsyncCRC32(crcQueueSize, writer.get()));
+  }
+  else
+    crc32.reset(new util::CRC32());
+  
   try
   {
     ftp::UploadSpeedControl speedControl(client, path);
-    ftp::OnlineTransferUpdater onlineUpdater(boost::this_thread::get_id(), stats::Direction::Upload,
+    ftp::OnlineTransferUpdater onlineUpdater(client, stats::Direction::Upload,
                                              data.State().StartTime());
     std::vector<char> asciiBuf;
-    char buffer[bufferSize];
     
+    // crc calculation needs the data in user space
+    // so those uploads continue to go via the buffer
+    int pipeFds[2] = { -1, -1 };
+    bool splice = !calcCrc && data.CanSplice() && pipe2(pipeFds, O_CLOEXEC) == 0;
+    auto pipeGuard = util::MakeScopeExit([&]
+    {
+      if (pipeFds[0] >= 0) close(pipeFds[0]);
+      if (pipeFds[1] >= 0) close(pipeFds[1]);
+    });
+    
+    while (splice)
+    {
+      size_t len = data.Splice(pipeFds[1], speedControl.Allowance(
+                                  std::max(spliceChunk, buffer.Size())));
+      data.State().Update(len);
+      
+      size_t remaining = len;
+      if (!SpliceToFile(pipeFds[0], fout->handle(), remaining))
+      {
+        DrainPipe(pipeFds[0], *fout, remaining);
+        splice = false;
+      }
+      
+      onlineUpdater.Update(data.State().Bytes());
+      speedControl.Apply(len);
+      if (buffer.Adapt()) fcntl(pipeFds[1], F_SETPIPE_SZ, buffer.Size());
+    }
+    
+    startWriter();
     while (true)
     {
-      size_t len = data.Read(buffer, sizeof(buffer));
+      char* bufp = buffer.Get() + buffered;
+      size_t len = data.Read(bufp, speedControl.Allowance(buffer.Size() - buffered));
       
-      char *bufp  = buffer;
-      if (data.DataType() == ftp::DataType::ASCII)
+      if (ascii)
       {
-        ftp::ASCIITranscodeSTOR(buffer, len, asciiBuf);
-        len = asciiBuf.size();
+        len = ftp::ASCIITranscodeSTOR(bufp, len, asciiBuf);
         bufp = asciiBuf.data();
       }
       
       data.State().Update(len);
       
-      fout->write(bufp, len);
+      if (calcCrc && !asyncCrc)
+        crc32->Update(reinterpret_cast<uint8_t*>(bufp), len);
+      
+      if (ascii)
+      {
+        fout->write(bufp, len);
+        if (asyncCrc) asyncCrc->Update(asciiBuf, len);
+      }
+      else
+      if ((buffered += len) == buffer.Size())
+      {
+        if (asyncCrc) asyncCrc->Update(buffer.Storage(), buffered);
+        else writer->Write(buffer.Storage(), buffered);
+        buffered = 0;
+        buffer.Adapt();
+      }
       
-      if (calcCrc) crc32->Update(reinterpret_cast<uint8_t*>(bufp), len);
       onlineUpdater.Update(data.State().Bytes());
-      speedControl.Apply();
+      speedControl.Apply(len);
     }
   }
   catch (const util::net::EndOfStream&) { }
@@ -314,6 +466,29 @@ void STORCommand::Execute()
     aborted = true;
   }
 
+  try
+  {
+    if (buffered > 0)
+    {
+      if (asyncCrc) asyncCrc->Update(buffer.Storage(), buffered);
+      else writer->Write(buffer.Storage(), buffered);
+    }
+    if (asyncCrc) asyncCrc->Flush();
+    if (writer) writer->Flush();
+  }
+  catch (const std::ios_base::failure& e)
+  {
+    control.Reply(ftp::DataCloseAborted,
+                  "Error while writing to disk: " + std::string(e.what()));
+    throw cmd::NoPostScriptError();
+  }
+
+  if (preallocated) 
+  {
+    e = fs::TrimPreallocated(fout->handle());
+    if (!e) logs::Error("Failed to release unused preallocated space: %1%", e.Message());
+  }
+  
   fout->close();
   data.Close();
   
@@ -347,6 +522,7 @@ void STORCommand::Execute()
   
   (void) countGuard;
   (void) fileGuard;
+  (void) trimGuard;
   (void) dataGuard;
 }
 
@@ -14,6 +14,7 @@ namespace cmd { namespace rfc
 class STORCommand : public Command
 {
   bool CalcCRC(const fs::VirtualPath& path);
+  off_t PreallocateSize(const fs::VirtualPath& path);
   void DupeMessage(const fs::VirtualPath& path);
   
 public:
@@ -301,20 +301,13 @@ Factory::Factory()
                       "Syntax: SITE SREPLY [ON|OFF]",
                       "Turn single line replies on and off" }, }
   };
+  
+  index.Build(defs);
 }
 
 CommandDefOpt Factory::LookupCustom(const std::string& command)
 {
-  const cfg::SiteCmd* match = nullptr;
-  for (auto& siteCmd : cfg::Get().SiteCmd())
-  {
-    if (siteCmd.Command() == command)
-    {
-      match = &siteCmd;
-      break;
-    }
-  }
-  
+  const cfg::SiteCmd* match = cfg::Get().SiteCmd(command);
   if (!match) return CommandDefOpt();
   
   CommandDefOpt def;
@@ -351,8 +344,17 @@ CommandDefOpt Factory::Lookup(const std::string& command, bool noCustom)
   if (!noCustom) def = LookupCustom(command);
   if (!def)
   {
-    CommandDefsMap::const_iterator it = factory->defs.find(command);
-    if (it != factory->defs.end()) def.reset(it->second);
+    uint64_t key = VerbIndex<CommandDef>::Pack(command);
+    if (key)
+    {
+      const CommandDef* found = factory->index.Find(key);
+      if (found) def.reset(*found);
+    }
+    else
+    {
+      CommandDefsMap::const_iterator it = factory->defs.find(command);
+      if (it != factory->defs.end()) def.reset(it->second);
+    }
   }
   return def;
 }
@@ -7,6 +7,7 @@
 #include <boost/optional.hpp>
 #include "util/string.hpp"
 #include "cmd/command.hpp"
+#include "cmd/verbindex.hpp"
 #include "ftp/client.hpp"
 #include "cfg/setting.hpp"
 
@@ -119,6 +120,7 @@ public:
 
 private:                                   
   CommandDefsMap defs;
+  VerbIndex<CommandDef> index;
    
   Factory();
   
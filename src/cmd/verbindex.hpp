@@ -0,0 +1,63 @@
+#ifndef __CMD_VERBINDEX_HPP
+#define __CMD_VERBINDEX_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unordered_map>
+
+namespace cmd
+{
+
+// Verbs of up to seven characters packed with their length into an int
+// are a perfect key, so looking one up is a short binary search over a
+// sorted vector rather than hashing the string. Longer verbs aren't
+// indexed and are left for the caller to find in its map.
+
+template <typename DefT>
+class VerbIndex
+{
+  typedef std::pair<uint64_t, const DefT*> Entry;
+  
+  std::vector<Entry> entries;
+  
+public:
+  static const size_t maximumLength = 7;
+  
+  static uint64_t Pack(const std::string& verb)
+  {
+    if (verb.empty() || verb.length() > maximumLength) return 0;
+    
+    uint64_t key = verb.length();
+    for (char ch : verb) key = (key << 8) | static_cast<unsigned char>(ch);
+    return key;
+  }
+  
+  void Build(const std::unordered_map<std::string, DefT>& defs)
+  {
+    entries.clear();
+    for (const auto& kv : defs)
+    {
+      uint64_t key = Pack(kv.first);
+      if (key) entries.emplace_back(key, &kv.second);
+    }
+    
+    std::sort(entries.begin(), entries.end(), 
+              [](const Entry& a, const Entry& b) { return a.first < b.first; });
+  }
+  
+  // key must be non zero, nullptr if there's no such verb
+  const DefT* Find(uint64_t key) const
+  {
+    auto it = std::lower_bound(entries.begin(), entries.end(), key,
+                [](const Entry& entry, uint64_t key) { return entry.first < key; });
+    if (it != entries.end() && it->first == key) return it->second;
+    return nullptr;
+  }
+};
+
+} /* cmd namespace */
+
+#endif
@@ -61,11 +61,16 @@ bool Cscript(ftp::Client& client, const std::string& group,
 bool Cscripts(ftp::Client& client, const std::string& command, 
       const std::string& fullCommand, CscriptType type, ftp::ReplyCode failCode)
 {
+  const cfg::Config& config = cfg::Get();
+  const auto& indexes = config.CscriptIndex(command);
+  if (indexes.empty()) return true;
+  
   std::string group = client.User().PrimaryGroup();
 
-  for (const auto& cscript : cfg::Get().Cscript())
+  for (size_t index : indexes)
   {
-    if (cscript.GetType() == type && cscript.Command() == command)
+    const auto& cscript = config.Cscript()[index];
+    if (cscript.GetType() == type)
     {
       if (!Cscript(client, group, cscript, fullCommand, type, failCode))
       {
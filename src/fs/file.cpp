@@ -2,6 +2,7 @@
 #include <cerrno>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <linux/falloc.h>
 #include "fs/file.hpp"
 #include "acl/user.hpp"
 #include "fs/path.hpp"
@@ -20,6 +21,28 @@ namespace PP = acl::path;
 namespace fs
 {
 
+namespace
+{
+
+// space reserved for an upload counts against free_space up front
+// so the reservation can't take the disk below the configured minimum
+util::Error CheckFreeSpace(const RealPath& dir, off_t reserve)
+{
+  unsigned long long freeBytes;
+  util::Error e = util::path::FreeDiskSpace(dir.ToString(), freeBytes);
+  if (!e) return e;
+  
+  unsigned long long reserveBytes = reserve;
+  if (reserveBytes > freeBytes ||
+      static_cast<unsigned long long>(cfg::Get().FreeSpace()) > 
+      (freeBytes - reserveBytes) / 1024)
+    return util::Error::Failure(ENOSPC);
+    
+  return util::Error::Success();
+}
+
+}
+
 util::Error DeleteFile(const RealPath& path)
 {
   if (unlink(path.CString()) < 0) return util::Error::Failure(errno);
@@ -68,17 +91,13 @@ util::Error RenameFile(const acl::User& user, const VirtualPath& oldPath,
   return RenameFile(MakeReal(oldPath), MakeReal(newPath));
 }
 
-FileSinkPtr CreateFile(const acl::User& user, const VirtualPath& path)
+FileSinkPtr CreateFile(const acl::User& user, const VirtualPath& path, off_t reserve)
 {
   util::Error e(PP::FileAllowed<PP::Upload>(user, path));
   if (!e) throw util::SystemError(e.Errno());
   
-  unsigned long long freeBytes;
-  e = util::path::FreeDiskSpace(MakeReal(path).Dirname().ToString(), freeBytes);
+  e = CheckFreeSpace(MakeReal(path).Dirname(), reserve);
   if (!e) throw util::SystemError(e.Errno());
-  
-  if (static_cast<unsigned long long>(cfg::Get().FreeSpace()) > freeBytes / 1024)
-    throw util::SystemError(ENOSPC);
 
   mode_t mode = cfg::Get().DlIncomplete() ? 0755 : 0644;
     
@@ -99,7 +118,8 @@ FileSinkPtr CreateFile(const acl::User& user, const VirtualPath& path)
   return std::make_shared<FileSink>(fd, boost::iostreams::close_handle);
 }
 
-FileSinkPtr AppendFile(const acl::User& user, const VirtualPath& path, off_t offset)
+FileSinkPtr AppendFile(const acl::User& user, const VirtualPath& path, off_t offset,
+                       off_t reserve)
 {
   util::Error e = PP::FileAllowed<PP::Resume>(user, path);
   if (!e) throw util::SystemError(e.Errno());
@@ -115,12 +135,8 @@ FileSinkPtr AppendFile(const acl::User& user, const VirtualPath& path, off_t off
     throw util::SystemError(e.Errno());
   }
 
-  unsigned long long freeBytes;
-  e = util::path::FreeDiskSpace(real.Dirname().ToString(), freeBytes);
+  e = CheckFreeSpace(real.Dirname(), reserve);
   if (!e) throw util::SystemError(e.Errno());
-  
-  if (static_cast<unsigned long long>(cfg::Get().FreeSpace()) > freeBytes / 1024)
-    throw util::SystemError(ENOSPC);
 
   int fd = open(real.CString(), O_WRONLY | O_APPEND);
   if (fd < 0) throw util::SystemError(errno);
@@ -142,6 +158,30 @@ FileSinkPtr AppendFile(const acl::User& user, const VirtualPath& path, off_t off
   return fout;
 }
 
+util::Error Preallocate(int fd, off_t offset, off_t len)
+{
+  // keep size so a short upload doesn't leave a zero filled tail behind
+  while (fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, len) < 0)
+  {
+    if (errno != EINTR) return util::Error::Failure(errno);
+  }
+  return util::Error::Success();
+}
+
+util::Error TrimPreallocated(int fd)
+{
+  struct stat st;
+  if (fstat(fd, &st) < 0) return util::Error::Failure(errno);
+  
+  // blocks reserved beyond the end of file are only released by a truncate
+  off_t allocated = st.st_blocks * 512;
+  off_t used = (st.st_size + st.st_blksize - 1) / st.st_blksize * st.st_blksize;
+  if (allocated > used && ftruncate(fd, st.st_size) < 0)
+    return util::Error::Failure(errno);
+    
+  return util::Error::Success();
+}
+
 FileSourcePtr OpenFile(const acl::User& user, const VirtualPath& path)
 {
   util::Error e = PP::FileAllowed<PP::Download>(user, path);
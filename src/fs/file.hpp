@@ -35,8 +35,11 @@ util::Error RenameFile(const RealPath& oldPath, const RealPath& newPath);
 util::Error RenameFile(const acl::User& user, const VirtualPath& oldPath,
                        const VirtualPath& newPath);
 
-FileSinkPtr CreateFile(const acl::User& user, const VirtualPath& path);
-FileSinkPtr AppendFile(const acl::User& user, const VirtualPath& path, off_t offset);
+FileSinkPtr CreateFile(const acl::User& user, const VirtualPath& path, off_t reserve = 0);
+FileSinkPtr AppendFile(const acl::User& user, const VirtualPath& path, off_t offset,
+                       off_t reserve = 0);
+util::Error Preallocate(int fd, off_t offset, off_t len);
+util::Error TrimPreallocated(int fd);
 FileSourcePtr OpenFile(const acl::User& user, const VirtualPath& path);
 util::Error UniqueFile(const acl::User& user, const VirtualPath& path, 
                        size_t filenameLength, VirtualPath& uniquePath);
@@ -0,0 +1,42 @@
+#include <fcntl.h>
+#include "fs/readahead.hpp"
+
+namespace fs
+{
+
+ReadAhead::ReadAhead(int fd, off_t offset, off_t window, bool dropBehind) :
+  fd(fd),
+  window(window),
+  dropBehind(dropBehind),
+  prefetched(offset),
+  dropped(offset)
+{
+  Advise(0, 0, POSIX_FADV_SEQUENTIAL);
+  Advance(offset);
+}
+
+void ReadAhead::Advise(off_t offset, off_t len, int advice)
+{
+  // hints only, failure doesn't affect the transfer
+  (void) posix_fadvise(fd, offset, len, advice);
+}
+
+void ReadAhead::Advance(off_t position)
+{
+  if (window <= 0) return;
+  
+  // start fetching the next window once we're into the last one
+  while (prefetched - position < window)
+  {
+    Advise(prefetched, window, POSIX_FADV_WILLNEED);
+    prefetched += window;
+  }
+  
+  if (dropBehind && position - dropped >= window)
+  {
+    Advise(dropped, position - dropped, POSIX_FADV_DONTNEED);
+    dropped = position;
+  }
+}
+
+} /* fs namespace */
@@ -0,0 +1,32 @@
+#ifndef __FS_READAHEAD_HPP
+#define __FS_READAHEAD_HPP
+
+#include <sys/types.h>
+
+namespace fs
+{
+
+// Page cache hints for a file being read sequentially. Keeps up to two
+// windows of the file prefetched ahead of the read position, and if 
+// enabled, drops pages behind it so large files don't push hotter ones
+// out of the cache. 
+
+class ReadAhead
+{
+  int fd;
+  off_t window;
+  bool dropBehind;
+  off_t prefetched;
+  off_t dropped;
+  
+  void Advise(off_t offset, off_t len, int advice);
+  
+public:
+  ReadAhead(int fd, off_t offset, off_t window, bool dropBehind);
+  
+  void Advance(off_t position);
+};
+
+} /* fs namespace */
+
+#endif
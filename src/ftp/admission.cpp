@@ -0,0 +1,132 @@
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#include "ftp/admission.hpp"
+#include "acl/misc.hpp"
+#include "cfg/get.hpp"
+#include "logs/logs.hpp"
+#include "util/net/ipaddress.hpp"
+
+namespace ftp
+{
+
+namespace pt = boost::posix_time;
+
+std::unique_ptr<Admission> Admission::instance;
+boost::once_flag Admission::instanceOnce = BOOST_ONCE_INIT;
+
+Admission::Admission() :
+  pending(0),
+  admitted(0)
+{
+}
+
+void Admission::CreateInstance()
+{
+  instance.reset(new Admission());
+}
+
+Admission& Admission::Get()
+{
+  boost::call_once(&CreateInstance, instanceOnce);
+  return *instance;
+}
+
+std::string Admission::Subnet(const std::string& ip)
+{
+  if (util::net::IPAddress::Validv4(ip))
+    return ip.substr(0, ip.rfind('.')) + ".0/24";
+
+  try
+  {
+    util::net::IPAddress addr(ip);
+    const unsigned char* bytes = static_cast<const unsigned char*>(addr.Addr());
+    std::ostringstream os;
+    os << std::hex << std::setfill('0');
+    for (int i = 0; i < 8; ++i) os << std::setw(2) << static_cast<int>(bytes[i]);
+    os << "/64";
+    return os.str();
+  }
+  catch (const util::net::InvalidIPAddressError&)
+  {
+    return ip;
+  }
+}
+
+// allows limit connections in a burst, refilling at limit per seconds
+bool Admission::Throttle(FullAtMap& buckets, const std::string& key, int limit, int seconds,
+                         const pt::ptime& now)
+{
+  if (limit <= 0) return false;
+
+  pt::time_duration interval = pt::microseconds(seconds * 1000000LL / limit);
+  pt::time_duration tolerance = pt::seconds(seconds) - interval;
+
+  auto it = buckets.find(key);
+  if (it == buckets.end())
+  {
+    buckets.insert(std::make_pair(key, now + interval));
+    return false;
+  }
+
+  if (it->second - now > tolerance) return true;
+  it->second = std::max(it->second, now) + interval;
+  return false;
+}
+
+void Admission::Prune(const pt::ptime& now)
+{
+  for (auto* buckets : { &addresses, &subnets })
+  {
+    for (auto it = buckets->begin(); it != buckets->end();)
+    {
+      if (it->second <= now) it = buckets->erase(it);
+      else ++it;
+    }
+  }
+}
+
+bool Admission::Admit(const std::string& ip)
+{
+  const cfg::Config& config = cfg::Get();
+
+  // hostname masks can't be checked until after a lookup, and
+  // bouncers pass on the real address once they're connected
+  if (!config.DNSLookup() && !config.IsBouncer(ip) && !acl::IPAllowed(ip))
+  {
+    logs::Security("BADADDRESS", "Refused connection from unknown address: %1%", ip);
+    return false;
+  }
+
+  int maxPending = config.MaxPending();
+  if (maxPending > 0 && pending >= maxPending)
+  {
+    logs::Debug("Refused connection from %1%, %2% connections already pending", ip, maxPending);
+    return false;
+  }
+
+  const auto& rate = config.ConnectionRate();
+  if (rate.PerAddress() > 0 || rate.PerSubnet() > 0)
+  {
+    auto now = pt::microsec_clock::local_time();
+    if (++admitted % pruneInterval == 0) Prune(now);
+
+    if (Throttle(addresses, ip, rate.PerAddress(), rate.Seconds(), now))
+    {
+      logs::Debug("Refused connection from %1%, address connecting too quickly", ip);
+      return false;
+    }
+
+    std::string subnet = Subnet(ip);
+    if (Throttle(subnets, subnet, rate.PerSubnet(), rate.Seconds(), now))
+    {
+      logs::Debug("Refused connection from %1%, subnet %2% connecting too quickly", ip, subnet);
+      return false;
+    }
+  }
+
+  ++pending;
+  return true;
+}
+
+} /* ftp namespace */
@@ -0,0 +1,58 @@
+#ifndef __FTP_ADMISSION_HPP
+#define __FTP_ADMISSION_HPP
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <boost/thread/once.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace ftp
+{
+
+// Decides whether a newly accepted connection gets a client thread.
+// Runs on the listener thread before any thread, dns or ident lookup
+// is spent on the connection.
+//
+// Connection rates are limited per address and per /24 (/64 for ipv6)
+// using the generic cell rate algorithm, each key only needs the time
+// its bucket will next be full, and keys are forgotten once it is.
+
+class Admission
+{
+  typedef std::unordered_map<std::string, boost::posix_time::ptime> FullAtMap;
+
+  FullAtMap addresses;
+  FullAtMap subnets;
+  std::atomic<int> pending;
+  unsigned admitted;
+
+  static const unsigned pruneInterval = 1024;
+
+  Admission();
+
+  bool Throttle(FullAtMap& buckets, const std::string& key, int limit, int seconds,
+                const boost::posix_time::ptime& now);
+  void Prune(const boost::posix_time::ptime& now);
+
+  static std::string Subnet(const std::string& ip);
+
+  static std::unique_ptr<Admission> instance;
+  static boost::once_flag instanceOnce;
+
+  static void CreateInstance();
+
+public:
+  bool Admit(const std::string& ip);
+  /* Listener thread only */
+
+  void HandshakeFinished() { --pending; }
+  /* Called once by each admitted client when it's displayed its banner or finished */
+
+  static Admission& Get();
+};
+
+} /* ftp namespace */
+
+#endif
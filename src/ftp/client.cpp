@@ -23,9 +23,9 @@ const acl::User& Client::User() const
   return pimpl->User();
 }
 
-bool Client::Accept(util::net::TCPListener& server)
+void Client::Accept(util::net::TCPSocket& pending)
 {
-  return pimpl->Accept(server);
+  pimpl->Accept(pending);
 }
 
 /*bool Client::IsFinished() const
@@ -108,6 +108,11 @@ const boost::posix_time::ptime Client::LoggedInAt() const
   return pimpl->LoggedInAt();
 }
 
+int Client::OnlineSlot() const
+{
+  return pimpl->OnlineSlot();
+}
+
 void Client::SetXDupeMode(xdupe::Mode xdupeMode)
 {
   pimpl->SetXDupeMode(xdupeMode);
@@ -224,6 +229,16 @@ void Client::SetUserUpdated()
   pimpl->SetUserUpdated();
 }
 
+bool Client::IsParked() const
+{
+  return pimpl->IsParked();
+}
+
+void Client::Resume()
+{
+  pimpl->Resume();
+}
+
 void Client::Start()
 {
   pimpl->Start();
@@ -30,7 +30,7 @@ namespace util
 class ProcessReader;
 namespace net
 {
-class TCPListener;
+class TCPSocket;
 class Endpoint;
 }
 }
@@ -58,7 +58,7 @@ public:
   acl::User& User();
   const acl::User& User() const;
   
-  bool Accept(util::net::TCPListener& server);
+  void Accept(util::net::TCPSocket& pending);
   bool IsFinished() const;
   void SetLoggedIn(bool kicked);
   void SetWaitingPassword(const acl::User& user, bool kickLogin);
@@ -81,6 +81,7 @@ public:
   const boost::posix_time::seconds& IdleTimeout() const;
   
   const boost::posix_time::ptime LoggedInAt() const;
+  int OnlineSlot() const;
   void SetXDupeMode(xdupe::Mode xdupeMode);
   xdupe::Mode XDupeMode() const;
   
@@ -109,6 +110,9 @@ public:
   bool IdntParse(const std::string& command);
   void SetUserUpdated();
   
+  bool IsParked() const;
+  void Resume();
+  
   void Start();
   void Join();
   bool TryJoin();
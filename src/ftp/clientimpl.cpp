@@ -8,7 +8,6 @@
 #include "util/verify.hpp"
 #include "util/error.hpp"
 #include "util/scopeguard.hpp"
-#include "util/net/tcplistener.hpp"
 #include "cmd/rfc/factory.hpp"
 #include "acl/path.hpp"
 #include "acl/types.hpp"
@@ -30,6 +29,10 @@
 #include "ftp/task/task.hpp"
 #include "ftp/online.hpp"
 #include "fs/directory.hpp"
+#include "ftp/reactor.hpp"
+#include "ftp/admission.hpp"
+#include "ftp/lookupcache.hpp"
+#include "ftp/sessionpool.hpp"
 
 namespace ftp
 {
@@ -44,8 +47,11 @@ ClientImpl::ClientImpl(Client& parent) :
   passwordAttemps(0),
   xdupeMode(xdupe::Mode::Disabled),
   kickLogin(false),
+  onlineSlot(-1),
   idleTimeout(boost::posix_time::seconds(cfg::Get().IdleTimeout().Timeout())),
-  ident("*")
+  ident("*"),
+  parked(false),
+  running(false)
 {
 }
 
@@ -75,7 +81,8 @@ void ClientImpl::SetState(ClientState state)
                  logs::QuoteOn(), "user", user->Name(), 
                 "group", user->PrimaryGroup(), 
                 "tagline", user->Tagline());
-    OnlineWriter::Get().LoggedOut(boost::this_thread::get_id());
+    OnlineWriter::Get().LoggedOut(onlineSlot);
+    onlineSlot = -1;
   }
 }
 
@@ -117,7 +124,7 @@ void ClientImpl::SetLoggedIn(bool kicked)
               "group", user->PrimaryGroup(), 
               "tagline", user->Tagline());
               
-  OnlineWriter::Get().LoggedIn(boost::this_thread::get_id(), parent, fs::WorkDirectory().ToString());
+  onlineSlot = OnlineWriter::Get().LoggedIn(parent, fs::WorkDirectory().ToString());
 }
 
 void ClientImpl::SetWaitingPassword(const acl::User& user, bool kickLogin)
@@ -164,22 +171,12 @@ bool ClientImpl::PasswordAttemptsExceeded() const
   return passwordAttemps >= maxPasswordAttemps;
 }
 
-bool ClientImpl::Accept(util::net::TCPListener& server)
+void ClientImpl::Accept(util::net::TCPSocket& pending)
 {
-  try
-  {
-    control.Accept(server);
-    ip = control.RemoteEndpoint().IP().IsMappedv4() ?
-         control.RemoteEndpoint().IP().ToUnmappedv4().ToString() :
-         control.RemoteEndpoint().IP().ToString();
-    return true;
-  }
-  catch(const util::net::NetworkError& e)
-  {
-    SetState(ClientState::Finished);
-    logs::Error("Error while accepting new client: %1%", e.Message());
-    return false;
-  }
+  control.Accept(pending);
+  ip = control.RemoteEndpoint().IP().IsMappedv4() ?
+       control.RemoteEndpoint().IP().ToUnmappedv4().ToString() :
+       control.RemoteEndpoint().IP().ToString();
 }
 
 void ClientImpl::DisplayBanner()
@@ -198,7 +195,7 @@ void ClientImpl::DisplayBanner()
   control.Format(ftp::ServiceReady, config.LoginPrompt());
 }
 
-void ClientImpl::IdleReset(std::string commandLine)
+void ClientImpl::IdleReset(const std::string& commandLine)
 {
   for (auto & mask : cfg::Get().IdleCommands())
     if (util::WildcardMatch(mask, commandLine, true))
@@ -207,40 +204,65 @@ void ClientImpl::IdleReset(std::string commandLine)
   idleExpires = idleTime + idleTimeout;
 }
 
+// same tokens as util::Split with compression on spaces, but assigned
+// into the strings left from the last command so their storage is reused
+void ClientImpl::SplitCommand(const std::string& commandLine)
+{
+  size_t count = 0;
+  size_t pos = 0;
+  while (true)
+  {
+    size_t end = commandLine.find(' ', pos);
+    if (count == commandArgs.size()) commandArgs.emplace_back();
+    commandArgs[count++].assign(commandLine, pos, end == std::string::npos ? end : end - pos);
+    if (end == std::string::npos) break;
+    
+    pos = commandLine.find_first_not_of(' ', end);
+    if (pos == std::string::npos) pos = commandLine.length();
+  }
+  
+  commandArgs.resize(count);
+}
+
 void ClientImpl::ExecuteCommand(const std::string& commandLine)
 {
   if (commandLine.empty()) return;
-  std::vector<std::string> args;
-  util::Split(args, commandLine, " ", true);
-  if (args.empty()) throw ProtocolError("Empty command.");
+  SplitCommand(commandLine);
   
-  std::string argStr(commandLine.substr(args[0].length()));
-  util::Trim(argStr);
-  util::ToUpper(args[0]);
+  commandArgStr.assign(commandLine, commandArgs[0].length(), std::string::npos);
+  util::Trim(commandArgStr);
+  util::ToUpper(commandArgs[0]);
   
-  currentCommand = args[0];
-  if (!argStr.empty()) currentCommand += " " + argStr;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    currentCommand.assign(commandArgs[0]);
+    if (!commandArgStr.empty())
+    {
+      currentCommand += ' ';
+      currentCommand += commandArgStr;
+    }
+  }
   
   if (State() == ClientState::LoggedIn)
   {
-    OnlineWriter::Get().Command(boost::this_thread::get_id(), currentCommand);
+    OnlineWriter::Get().Command(onlineSlot, currentCommand);
   }
   
-  cmd::rfc::CommandDefOptRef def(cmd::rfc::Factory::Lookup(args[0]));
+  cmd::rfc::CommandDefOptRef def(cmd::rfc::Factory::Lookup(commandArgs[0]));
   if (!def)
   {
     control.Reply(ftp::CommandUnrecognised, "Command not understood");
   }
-  else if (!def->CheckArgs(args))
+  else if (!def->CheckArgs(commandArgs))
   {
     control.Reply(ftp::SyntaxError, "Syntax: " + def->Syntax());
   }
   else if (CheckState(def->RequiredState()) &&
            (state != ClientState::LoggedIn ||
-            exec::Cscripts(parent, args[0], currentCommand, exec::CscriptType::Pre, 
+            exec::Cscripts(parent, commandArgs[0], currentCommand, exec::CscriptType::Pre, 
                 def->FailCode())))
   {
-    cmd::CommandPtr command(def->Create(parent, argStr, args));
+    cmd::CommandPtr command(def->Create(parent, commandArgStr, commandArgs));
     if (!command)
     {
       control.Reply(ftp::NotImplemented, "Command not implemented");
@@ -252,7 +274,7 @@ void ClientImpl::ExecuteCommand(const std::string& commandLine)
         command->Execute();
 
         if (state == ClientState::LoggedIn)
-          exec::Cscripts(parent, args[0], currentCommand, exec::CscriptType::Post, 
+          exec::Cscripts(parent, commandArgs[0], currentCommand, exec::CscriptType::Post, 
                   ftp::ActionNotOkay);
       }
       catch (const cmd::SyntaxError&)
@@ -268,11 +290,14 @@ void ClientImpl::ExecuteCommand(const std::string& commandLine)
     }
   }
   
-  currentCommand = "";
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    currentCommand.clear();
+  }
   
   if (State() == ClientState::LoggedIn)
   {
-    OnlineWriter::Get().Idle(boost::this_thread::get_id());
+    OnlineWriter::Get().Idle(onlineSlot);
   }
 }
 
@@ -304,7 +329,42 @@ bool ClientImpl::ReloadUser()
   return true;
 }
 
-void ClientImpl::Handle()
+bool ClientImpl::Park(const boost::posix_time::time_duration* timeout)
+{
+  namespace pt = boost::posix_time;
+  
+  // bursts of commands are serviced on the same thread, the thread is only
+  // released once the session has been idle for a little while
+  pt::seconds delay(parkDelay);
+  if (timeout && *timeout <= delay) return false;
+  if (control.CommandPending(delay)) return false;
+  
+  parkedWorkDir.reset(fs::WorkDirectory());
+  
+  // the reactor resumes the session via a server task that needs the mutex,
+  // so ownership can be given up once the park has succeeded
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!Reactor::Get().Park(parent, control.Socket(), timeout ? &idleExpires : nullptr))
+  {
+    parkedWorkDir = boost::none;
+    return false;
+  }
+  
+  parked = true;
+  running = false;
+  
+  // a dedicated thread is detached so it's released as soon as it
+  // returns rather than when the session is next resumed
+  if (started)
+  {
+    thread.detach();
+    started = false;
+  }
+  
+  return true;
+}
+
+bool ClientImpl::Handle()
 {
   namespace pt = boost::posix_time;
 
@@ -321,17 +381,57 @@ void ClientImpl::Handle()
       timeoutPtr = &timeout;
     }
     
+    if (State() == ClientState::LoggedIn && Park(timeoutPtr)) return true;
+    
     std::string command = control.NextCommand(timeoutPtr);    
     if (userUpdated && !ReloadUser()) break;
     ExecuteCommand(command);
     cfg::UpdateLocal();
   }
+  
+  return false;
+}
+
+void ClientImpl::Resume()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!parked) return;
+  parked = false;
+  running = true;
+  
+  // a thread of its own is only started when every worker is busy
+  if (!SessionPool::Get().Push(this, [this]() { Run(); }))
+    util::Thread::Start();
+}
+
+void ClientImpl::Start()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  running = true;
+  util::Thread::Start();
+}
+
+void ClientImpl::Join()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while (running) runningCond.wait(lock);
+  util::Thread::Join();
+}
+
+bool ClientImpl::TryJoin()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return !running && util::Thread::TryJoin();
 }
 
 void ClientImpl::Interrupt()
 {
   SetState(ClientState::Finished);
-  Stop();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (started) thread.interrupt();
+    else SessionPool::Get().Interrupt(this);
+  }
   control.Interrupt();
   data.Interrupt();
   child.Interrupt();
@@ -341,15 +441,22 @@ void ClientImpl::LookupIdent()
 {
   if (!cfg::Get().IdentLookup() || ident != "*") return;
   
+  // an ident reply only speaks for this connection, other users on a
+  // shared host or behind nat may be connecting from the same ip
+  LookupCache& cache = LookupCache::Get();
+  if (cache.IdentFailed(ip)) return;
+  
   try
   {
-    util::net::IdentClient identClient(control.LocalEndpoint(), control.RemoteEndpoint());
+    util::net::IdentClient identClient(control.LocalEndpoint(), control.RemoteEndpoint(),
+                                       util::TimePair(cfg::Get().LookupTimeout(), 0));
     ident = identClient.Ident();
   }
   catch (util::net::NetworkError& e)
   {
     logs::Error("Unable to lookup ident for connection from %1%: %2%",
                 control.RemoteEndpoint(), e.Message());
+    cache.SetIdentFailed(ip);
   }
 }
 
@@ -389,27 +496,41 @@ bool ClientImpl::PreCheckAddress()
   return true;
 }
 
+void ClientImpl::AwaitHostname(const std::shared_future<std::string>& resolving,
+                               const std::chrono::steady_clock::time_point& deadline)
+{
+  std::string hostname = ip;
+  if (resolving.wait_until(deadline) == std::future_status::ready)
+    hostname = resolving.get();
+  else
+    logs::Debug("Timeout while looking up hostname for %1%", ip);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  this->hostname = hostname;
+}
+
 void ClientImpl::HostnameLookup()
 {
   if (!cfg::Get().DNSLookup() || !hostname.empty()) return;
   
-  try
-  { 
+  auto deadline = std::chrono::steady_clock::now() + 
+                  std::chrono::seconds(cfg::Get().LookupTimeout());
+  AwaitHostname(LookupCache::Get().Hostname(ip), deadline);
+}
+
+void ClientImpl::LookupAddresses()
+{
+  auto deadline = std::chrono::steady_clock::now() + 
+                  std::chrono::seconds(cfg::Get().LookupTimeout());
   
-    std::string hostname = util::net::ReverseResolve(util::net::IPAddress(ip));
-    
-    {
-      std::lock_guard<std::mutex> lock(mutex);
-      this->hostname = hostname;
-    }
-  }
-  catch (const util::net::NetworkError&)
-  {
-    {
-      std::lock_guard<std::mutex> lock(mutex);
-      this->hostname = ip;
-    }
-  }
+  // hostname resolves in the background while we wait on ident
+  std::shared_future<std::string> resolving;
+  if (cfg::Get().DNSLookup() && hostname.empty())
+    resolving = LookupCache::Get().Hostname(ip);
+  
+  LookupIdent();
+  
+  if (resolving.valid()) AwaitHostname(resolving, deadline);
 }
 
 std::string ClientImpl::SanitiseAddress(std::string address, LogAddresses log) const
@@ -510,14 +631,20 @@ bool ClientImpl::IdntParse(const std::string& command)
   return IdntUpdate(ident, ip, hostname);
 }
 
-void ClientImpl::InnerRun()
+bool ClientImpl::InnerRun()
 {
+  bool pending = true;
+  auto pendingGuard = util::MakeScopeExit([&]
+  {
+    if (pending) Admission::Get().HandshakeFinished();
+  });
+  
   if (!cfg::Get().IsBouncer(ip))
   {
     if (cfg::Get().BouncerOnly() && !control.RemoteEndpoint().IP().IsLoopback())
     {
       logs::Security("NONBOUNCER", "Refused connection not from a bouncer address: %1%", HostnameAndIP(LogAddresses::Error));
-      return;
+      return false;
     }
   }
   else
@@ -528,44 +655,55 @@ void ClientImpl::InnerRun()
       if (cfg::Get().BouncerOnly())
       {
         logs::Security("IDNTTIMEOUT", "Timeout while waiting for IDNT command from bouncer: ", HostnameAndIP(LogAddresses::Error));
-        return;
+        return false;
       }
     }
     else
     if (!IdntParse(command))
     {
       logs::Security("BADIDNT", "Malformed IDNT command from bouncer: ", HostnameAndIP(LogAddresses::Error));
-      return;
+      return false;
     }
   }
 
-  HostnameLookup();
+  LookupAddresses();
 
-  if (!PreCheckAddress()) return;
-  
-  LookupIdent();
+  if (!PreCheckAddress()) return false;
   
   logs::Debug("Servicing client connected from %1%@%2%", ident, HostnameAndIP(LogAddresses::Normal));
     
   DisplayBanner();
-  Handle();
+  
+  Admission::Get().HandshakeFinished();
+  pending = false;
+  
+  (void) pendingGuard;
+  return Handle();
 }
 
-void ClientImpl::Run()
+bool ClientImpl::Serve()
 {
-  util::SetProcessTitle("CLIENT");
-  
+  bool parking = false;
   auto finishedGuard = util::MakeScopeExit([&]
   {
+    if (parking) return;
     SetState(ClientState::Finished);
     std::make_shared<ftp::task::ClientFinished>(parent)->Push();
     if (user) db::mail::LogOffPurgeTrash(user->ID());
     LogTraffic();
   });
 
- try
+  try
   {
-    InnerRun();
+    if (parkedWorkDir)
+    {
+      // session was parked while idle, pick up where it left off
+      fs::SetWorkDirectory(*parkedWorkDir);
+      parkedWorkDir = boost::none;
+      parking = Handle();
+    }
+    else
+      parking = InnerRun();
   }
   catch (const util::net::TimeoutError& e)
   {
@@ -591,6 +729,26 @@ void ClientImpl::Run()
   }
   
   (void) finishedGuard; /* silence unused variable warning */
+  return parking;
+}
+
+void ClientImpl::Run()
+{
+  util::SetProcessTitle("CLIENT");
+  
+  // a parked session has already given up ownership and may be
+  // running on another thread by now
+  bool parking = false;
+  auto runningGuard = util::MakeScopeExit([&]
+  {
+    if (parking) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+    runningCond.notify_all();
+  });
+  
+  parking = Serve();
+  (void) runningGuard;
 }
 
 } /* ftp namespace */
@@ -4,6 +4,9 @@
 #include <string>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <future>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/optional.hpp>
 #include "acl/user.hpp"
@@ -17,14 +20,6 @@
 #include "util/processreader.hpp"
 #include "ftp/enums.hpp"
 
-namespace util
-{
-namespace net
-{
-class TCPListener;
-}
-}
-
 
 namespace ftp 
 {
@@ -48,7 +43,10 @@ class ClientImpl : public util::Thread
   xdupe::Mode xdupeMode;
   std::string confirmCommand;
   std::string currentCommand;
+  std::vector<std::string> commandArgs;
+  std::string commandArgStr;
   bool kickLogin;
+  int onlineSlot;
 
   boost::posix_time::ptime loggedInAt;
   boost::posix_time::ptime idleExpires;
@@ -59,18 +57,30 @@ class ClientImpl : public util::Thread
   std::string ip;
   std::string hostname;
   
+  std::atomic<bool> parked;
+  boost::optional<fs::VirtualPath> parkedWorkDir;
+  std::condition_variable runningCond;
+  bool running; // a thread, dedicated or pooled, owns the session
+  
   static std::atomic_bool siteopOnly;
   
   static const int maxPasswordAttemps = 3;
+  static const int parkDelay = 1; // seconds idle before releasing thread
   
   void DisplayBanner();
+  void SplitCommand(const std::string& commandLine);
   void ExecuteCommand(const std::string& commandLine);
-  void Handle();
+  bool Park(const boost::posix_time::time_duration* timeout);
+  bool Handle();
   bool CheckState(ClientState reqdState);
-  void InnerRun();
+  bool InnerRun();
+  bool Serve();
   void Run();
   void LookupIdent();
-  void IdleReset(std::string commandLine)  ;
+  void LookupAddresses();
+  void AwaitHostname(const std::shared_future<std::string>& resolving,
+                     const std::chrono::steady_clock::time_point& deadline);
+  void IdleReset(const std::string& commandLine);
   bool ReloadUser();
   std::string SanitiseAddress(std::string address, LogAddresses log) const;
   
@@ -86,7 +96,7 @@ public:
   acl::User& User() { return *user; }
   const acl::User& User() const { return *user; }
   
-  bool Accept(util::net::TCPListener& server);
+  void Accept(util::net::TCPSocket& pending);
   bool IsFinished() const;
   void SetLoggedIn(bool kicked);
   void SetWaitingPassword(const acl::User& user, bool kickLogin);
@@ -113,6 +123,8 @@ public:
   const boost::posix_time::ptime LoggedInAt() const
   { return loggedInAt; }
   
+  int OnlineSlot() const { return onlineSlot; }
+  
   void SetXDupeMode(xdupe::Mode xdupeMode)
   { this->xdupeMode = xdupeMode; }
   xdupe::Mode XDupeMode() const { return xdupeMode; }
@@ -174,6 +186,13 @@ public:
   bool IdntParse(const std::string& command);
   
   void SetUserUpdated() { userUpdated = true; }  
+  
+  bool IsParked() const { return parked; }
+  void Resume();
+  
+  void Start();
+  void Join();
+  bool TryJoin();
 };
 
 } /* ftp namespace */
@@ -15,9 +15,9 @@ Control::~Control()
 {
 }
 
-void Control::Accept(util::net::TCPListener& listener)
+void Control::Accept(util::net::TCPSocket& pending)
 {
-  pimpl->Accept(listener);
+  pimpl->Accept(pending);
 }
 
 std::string Control::NextCommand(const boost::posix_time::time_duration* timeout)
@@ -25,6 +25,11 @@ std::string Control::NextCommand(const boost::posix_time::time_duration* timeout
   return pimpl->NextCommand(timeout);
 }
 
+bool Control::CommandPending(const boost::posix_time::time_duration& timeout)
+{
+  return pimpl->CommandPending(timeout);
+}
+
 void Control::PartReply(ReplyCode code, const std::string& message)
 {
   pimpl->PartReply(code, message);
@@ -65,6 +70,11 @@ const util::net::Endpoint& Control::LocalEndpoint() const
   return pimpl->LocalEndpoint();
 }
 
+int Control::Socket() const
+{
+  return pimpl->Socket();
+}
+
 bool Control::IsTLS() const
 {
   return pimpl->IsTLS();
@@ -17,7 +17,6 @@ class time_duration;
 
 namespace util { namespace net
 {
-class TCPListener;
 class TCPSocket;
 class Endpoint;
 }
@@ -42,9 +41,10 @@ public:
   Control();
   ~Control();
   
-  void Accept(util::net::TCPListener& listener);
+  void Accept(util::net::TCPSocket& pending);
  
   std::string NextCommand(const boost::posix_time::time_duration* timeout = nullptr);
+  bool CommandPending(const boost::posix_time::time_duration& timeout);
   
   ::ftp::Format PartFormat;
   ::ftp::Format Format;
@@ -64,6 +64,8 @@ public:
  
   const util::net::Endpoint& LocalEndpoint() const;
   
+  int Socket() const;
+  
   bool IsTLS() const;
   std::string TLSCipher() const;
   
@@ -1,5 +1,6 @@
 #include <csignal>
 #include <iomanip>
+#include <algorithm>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/bind.hpp>
@@ -7,7 +8,6 @@
 #include "ftp/controlimpl.hpp"
 #include "util/string.hpp"
 #include "util/verify.hpp"
-#include "util/net/tcplistener.hpp"
 #include "logs/logs.hpp"
 #include "ftp/error.hpp"
 #include "ftp/util.hpp"
@@ -24,9 +24,9 @@ ControlImpl::ControlImpl(util::net::TCPSocket** socket) :
   *socket = &this->socket;
 }
 
-void ControlImpl::Accept(util::net::TCPListener& listener)
+void ControlImpl::Accept(util::net::TCPSocket& pending)
 {
-  listener.Accept(socket);
+  socket.Accept(pending);
 }
 
 void ControlImpl::SendReply(ReplyCode code, bool part, const std::string& message)
@@ -39,14 +39,25 @@ void ControlImpl::SendReply(ReplyCode code, bool part, const std::string& messag
   logs::Debug(reply.str());
   reply << "\r\n";
   
-  const std::string& str = reply.str();
-  Write(str.c_str(), str.length());
+  pending += reply.str();
 
   if (lastCode != code && lastCode != CodeNotSet && code != ftp::NoCode)
+  {
+    FlushReplies();
     throw ProtocolError("Invalid reply code sequence.");
+  }
   if (code != ftp::NoCode) lastCode = code;
 }
 
+void ControlImpl::FlushReplies()
+{
+  if (pending.empty()) return;
+  
+  std::string replies;
+  replies.swap(pending);
+  Write(replies.c_str(), replies.length());
+}
+
 void ControlImpl::PartReply(ReplyCode code, const std::string& messages)
 {
   assert(code != CodeNotSet);
@@ -58,7 +69,10 @@ void ControlImpl::PartReply(ReplyCode code, const std::string& messages)
     deferred.insert(deferred.end(), splitMessages.begin(), splitMessages.end());
   }
   else
+  {
     MultiReply(code, false, messages);
+    FlushReplies();
+  }
 }
 
 void ControlImpl::Reply(ReplyCode code, const std::string& messages)
@@ -71,6 +85,7 @@ void ControlImpl::Reply(ReplyCode code, const std::string& messages)
   }
   
   MultiReply(code, true, messages);
+  FlushReplies();
   lastCode = CodeNotSet;
 }
 
@@ -98,25 +113,17 @@ void ControlImpl::NegotiateTLS()
   socket.HandshakeTLS(util::net::TLSSocket::Server);
 }
 
-std::string ControlImpl::NextCommand(const boost::posix_time::time_duration* timeout)
+int ControlImpl::WaitInput(int pollTimeout)
 {
-  sigset_t mask;
-  sigfillset(&mask);
-  sigdelset(&mask, SIGUSR1);
+  // commands pipelined behind the last one may already be buffered
+  if (socket.HasBufferedInput()) return POLLIN;
   
   struct pollfd fds[1];
   fds[0].fd = socket.Socket();
   fds[0].events = POLLIN;
   fds[0].revents = 0;
 
-  int pollTimeout = !timeout ? -1 : timeout->total_milliseconds();
-  
   int n = poll(fds, 1, pollTimeout);
-  if (!n)
-  {
-    throw util::net::TimeoutError();
-  }
-  else
   if (n < 0)
   {
     if (errno == EINTR)
@@ -129,8 +136,21 @@ std::string ControlImpl::NextCommand(const boost::posix_time::time_duration* tim
      throw util::net::NetworkSystemError(errno);
     }
   }
+  
+  return n ? fds[0].revents : 0;
+}
 
-  if (fds[0].revents & POLLIN)
+std::string ControlImpl::NextCommand(const boost::posix_time::time_duration* timeout)
+{
+  int pollTimeout = !timeout ? -1 : std::max<long long>(0, timeout->total_milliseconds());
+  
+  int revents = WaitInput(pollTimeout);
+  if (!revents)
+  {
+    throw util::net::TimeoutError();
+  }
+
+  if (revents & POLLIN)
   {
     std::string commandLine;
     socket.Getline(commandLine, false);
@@ -142,10 +162,15 @@ std::string ControlImpl::NextCommand(const boost::posix_time::time_duration* tim
     return commandLine;
   }
 
-  if (fds[0].revents & POLLHUP) throw util::net::EndOfStream();
+  if (revents & POLLHUP) throw util::net::EndOfStream();
   throw util::net::NetworkError();
 }
 
+bool ControlImpl::CommandPending(const boost::posix_time::time_duration& timeout)
+{
+  return WaitInput(std::max<long long>(0, timeout.total_milliseconds())) != 0;
+}
+
 std::string ControlImpl::WaitForIdnt()
 {
   try
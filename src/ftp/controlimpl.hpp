@@ -31,14 +31,18 @@ class ControlImpl
   std::string commandLine;
   bool singleLineReplies;
   std::vector<std::string> deferred;
+  std::string pending;
   
   long bytesRead;
   long bytesWrite;
   
   void SendReply(ReplyCode code, bool part, const std::string& message);
+  void FlushReplies();
   void MultiReply(ReplyCode code, bool final, const std::vector<std::string>& messages);
   void MultiReply(ReplyCode code, bool final, const std::string& messages);
   
+  int WaitInput(int pollTimeout);
+  
   size_t Read(char* buffer, size_t size)
   { 
     size_t len = socket.Read(buffer, size);
@@ -49,9 +53,10 @@ class ControlImpl
 public:  
   ControlImpl(util::net::TCPSocket** socket);
   
-  void Accept(util::net::TCPListener& listener);
+  void Accept(util::net::TCPSocket& pending);
  
   std::string NextCommand(const boost::posix_time::time_duration* timeout = nullptr);
+  bool CommandPending(const boost::posix_time::time_duration& timeout);
   
   void PartReply(ReplyCode code, const std::string& message);
   void Reply(ReplyCode code, const std::string& message);
@@ -75,6 +80,8 @@ public:
   const util::net::Endpoint& LocalEndpoint() const
   { return socket.LocalEndpoint(); }
   
+  int Socket() const { return socket.Socket(); }
+  
   bool IsTLS() const { return socket.IsTLS(); }
   std::string TLSCipher() const { return socket.TLSCipher(); }
   
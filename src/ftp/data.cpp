@@ -13,6 +13,8 @@
 #include "ftp/error.hpp"
 #include "ftp/control.hpp"
 #include "util/verify.hpp"
+#include "util/net/tlscontext.hpp"
+#include "ftp/zstream.hpp"
 
 namespace util
 {
@@ -37,18 +39,40 @@ Data::Data(Client& client) :
            ::ftp::EPSVMode::Normal),
   dataType(::ftp::DataType::Binary),
   sscnMode(::ftp::SSCNMode::Server),
+  transferMode(::ftp::TransferMode::Stream),
   restartOffset(0),
+  allocateSize(0),
   bytesRead(0),
-  bytesWrite(0)
+  bytesWrite(0),
+  nextControlCheck(boost::posix_time::neg_infin),
+  nonBlocking(false)
 {
 }
 
+Data::~Data()
+{
+  ReleaseListener();
+}
+
+void Data::ReleaseListener()
+{
+  std::unique_ptr<PassiveListener> released;
+  {
+    std::lock_guard<std::mutex> lock(listenerMutex);
+    released = std::move(listener);
+  }
+  
+  if (released && released->Pooled()) 
+    PassivePool::Get().Return(std::move(released));
+}
+
 void Data::InitPassive(util::net::Endpoint& ep, PassiveType pasvType)
 {
   using namespace util::net;
 
   socket.Close();
-  listener.Close();
+  socketPort.Release();
+  ReleaseListener();
   
   boost::optional<util::net::IPAddress> ip;
   // unable to use alternative pasv_addr if espv mode isn't Full
@@ -86,35 +110,60 @@ void Data::InitPassive(util::net::Endpoint& ep, PassiveType pasvType)
   if (pasvType == PassiveType::PASV && ip->Family() == IPFamily::IPv6)
     FindPartnerIP(*ip, *ip);
 
-  boost::optional<int> firstPort;
-  while (true)
+  // users that may fxp can't be held to their own ip, so they're
+  // given a listener of their own rather than one from the pool
+  bool logging;
+  bool pooled = cfg::Get().PasvPool() > 0 &&
+                !acl::AllowFxpReceive(client.User(), logging) &&
+                !acl::AllowFxpSend(client.User(), logging);
+  std::unique_ptr<PassiveListener> newListener;
+  if (pooled) newListener = PassivePool::Get().Borrow(*ip);
+  
+  if (!newListener)
   {
-    int port = PortAllocator<PortType::Passive>::Get().NextPort();
-    if (!firstPort) firstPort.reset(port);
-    else if (port == *firstPort) 
-      throw util::net::NetworkError("All ports exhausted.");
-      
-    try
-    {
-      listener.Listen(Endpoint(*ip, port));
-      break;
-    }
-    catch (const util::net::NetworkSystemError& e)
+    newListener.reset(new PassiveListener(pooled));
+    
+    // ports held by this process are never handed out, so only those
+    // in use by something else can fail to bind
+    auto& allocator = PortAllocator<PortType::Passive>::Get();
+    boost::optional<int> firstPort;
+    while (true)
     {
-      if (e.Errno() != EADDRINUSE)
-        throw;
+      int port = allocator.NextPort();
+      if (port == PortAllocatorImpl::noPort || port == firstPort)
+        throw util::net::NetworkError("All ports exhausted.");
+      if (!firstPort) firstPort.reset(port);
+      
+      newListener->Port().Reset(allocator, port);
+      try
+      {
+        newListener->Listener().Listen(Endpoint(*ip, port));
+        break;
+      }
+      catch (const util::net::NetworkSystemError& e)
+      {
+        newListener->Port().Release();
+        if (e.Errno() != EADDRINUSE)
+          throw;
+      }
     }
   }
+  
+  {
+    std::lock_guard<std::mutex> lock(listenerMutex);
+    listener = std::move(newListener);
+  }
 
   this->pasvType = pasvType;
-  ep = listener.Endpoint();
+  ep = listener->Listener().Endpoint();
 }
 
 void Data::InitActive(const util::net::Endpoint& ep)
 {
   pasvType = PassiveType::None;
   socket.Close();
-  listener.Close();
+  socketPort.Release();
+  ReleaseListener();
   
   boost::optional<util::net::IPAddress> localIP;
   std::string firstAddr;
@@ -140,14 +189,16 @@ void Data::InitActive(const util::net::Endpoint& ep)
   
   if (!localIP) localIP = util::net::IPAddress(ep.Family());
   
+  auto& allocator = PortAllocator<PortType::Active>::Get();
   boost::optional<int> firstPort;
   while (true)
   {
-    int localPort = PortAllocator<PortType::Active>::Get().NextPort();
-    if (!firstPort) firstPort.reset(localPort);
-    else if (localPort == *firstPort) 
+    int localPort = allocator.NextPort();
+    if (localPort == PortAllocatorImpl::noPort || localPort == firstPort)
       throw util::net::NetworkError("All ports exhausted.");
+    if (!firstPort) firstPort.reset(localPort);
       
+    socketPort.Reset(allocator, localPort);
     try
     {
       socket.Connect(ep, util::net::Endpoint(*localIP, localPort));
@@ -155,6 +206,7 @@ void Data::InitActive(const util::net::Endpoint& ep)
     }
     catch (const util::net::NetworkSystemError& e)
     {
+      socketPort.Release();
       if (e.Errno() != EADDRINUSE)
         throw;
     }
@@ -163,10 +215,22 @@ void Data::InitActive(const util::net::Endpoint& ep)
 
 void Data::Open(TransferType transferType)
 {
+  nonBlocking = false;
   if (pasvType != PassiveType::None)
   {
-    assert(listener.IsListening());
-    listener.Accept(socket);
+    assert(listener && listener->Listener().IsListening());
+    while (true)
+    {
+      listener->Listener().Accept(socket);
+      
+      // pooled listeners sit on the same ports from one session to the next,
+      // so only connections from this session's client are accepted
+      if (!listener->Pooled() || !IsFXP()) break;
+      
+      logs::Debug("Dropped unexpected connection from %1% on pooled passive listener for %2%",
+                  socket.RemoteEndpoint(), client.User().Name());
+      socket.Close();
+    }
   }
   else
   if (!socket.IsConnected())
@@ -193,6 +257,8 @@ void Data::Open(TransferType transferType)
     }
   }
   
+  if (cfg::Get().SocketBuffer() > 0) socket.SetBuffers(cfg::Get().SocketBuffer());
+  
   if (protection)
   {
     util::net::TLSSocket::HandshakeRole role = util::net::TLSSocket::Server;
@@ -201,12 +267,66 @@ void Data::Open(TransferType transferType)
         (transferType == TransferType::Upload ||
          transferType == TransferType::Download))
       role = util::net::TLSSocket::Client;  
-    socket.HandshakeTLS(role);
+    socket.HandshakeTLS(role, role == util::net::TLSSocket::Server ? 
+                              client.Control().socket : nullptr,
+                        transferType == TransferType::Download);
+                        
+    if (role == util::net::TLSSocket::Server)
+    {
+      long handshakes = util::net::TLSServerContext::Handshakes();
+      long resumptions = util::net::TLSServerContext::Resumptions();
+      logs::Debug("TLS session %1% on data connection for %2%, %3%/%4% handshakes resumed (%5%%%)",
+                  socket.IsTLSResumed() ? "resumed" : "negotiated", client.User().Name(),
+                  resumptions, handshakes, handshakes > 0 ? resumptions * 100 / handshakes : 0);
+    }
+  }
+  
+  if (transferMode == ::ftp::TransferMode::Deflate)
+  {
+    try
+    {
+      if (transferType == TransferType::Upload) inflater.reset(new Inflater());
+      else deflater.reset(new Deflater(cfg::Get().ModeZLevel()));
+    }
+    catch (const util::RuntimeError& e)
+    {
+      socket.Close();
+      throw util::net::NetworkError(e.Message());
+    }
   }
   
   state.Start(transferType);
 }
 
+void Data::FinishCompression()
+{
+  // a deflater is only left once all writes have succeeded, so there's
+  // a client still reading and expecting the end of the stream
+  if (!deflater) return;
+  try
+  {
+    auto& output = deflater->Finish();
+    socket.Write(output.data(), output.size());
+  }
+  catch (const util::RuntimeError& e)
+  {
+    logs::Debug("Unable to finish compressed transfer for %1%: %2%", 
+                client.User().Name(), e.Message());
+  }
+  deflater.reset();
+}
+
+void Data::Close()
+{
+  FinishCompression();
+  inflater.reset();
+  restartOffset = 0;
+  allocateSize = 0;
+  socket.Close();
+  socketPort.Release();
+  state.Stop();
+}
+
 bool Data::IsFXP() const
 {
   return socket.RemoteEndpoint().IP() != client.Control().RemoteEndpoint().IP();
@@ -262,6 +382,8 @@ void Data::HandleControl(int revents)
         client.Control().Reply(ftp::BadCommandSequence, 
                   "Unsupported command during transfer");
       }
+      
+      return;
     }
     
     if (revents & POLLHUP) throw util::net::EndOfStream();
@@ -273,7 +395,7 @@ void Data::HandleControl(int revents)
   }
 }
 
-size_t Data::Read(char* buffer, size_t size)
+void Data::WaitReadable()
 {
   int pollTimeout = (socket.Timeout().Seconds() * 1000 ) + 
                     (socket.Timeout().Microseconds() / 1000);
@@ -306,13 +428,106 @@ size_t Data::Read(char* buffer, size_t size)
     }
     
     if (fds[0].revents > 0) HandleControl(fds[0].revents);
-    if (fds[1].revents & POLLIN) return socket.Read(buffer, size);
+    // control activity alone, such as a STAT, doesn't affect the transfer
+    if (!fds[1].revents) continue;
+    if (fds[1].revents & POLLIN) return;
     if (fds[1].revents & POLLHUP) throw util::net::EndOfStream();
     throw util::net::NetworkError();
   }
 }
 
-void Data::Write(const char* buffer, size_t len)
+void Data::CheckControl()
+{
+  auto now = boost::posix_time::microsec_clock::local_time();
+  if (now < nextControlCheck) return;
+  nextControlCheck = now + boost::posix_time::milliseconds(controlCheckInterval);
+  
+  bool pending;
+  try
+  {
+    pending = client.Control().CommandPending(boost::posix_time::milliseconds(0));
+  }
+  catch (const util::net::NetworkError& e)
+  {
+    throw ftp::ControlError(std::current_exception());
+  }
+  
+  if (pending) HandleControl(POLLIN);
+}
+
+size_t Data::Read(char* buffer, size_t size)
+{
+  if (!inflater) return ReadRaw(buffer, size);
+  
+  while (true)
+  {
+    if (!inflater->NeedsInput() || inflater->Finished())
+    {
+      size_t len;
+      try
+      {
+        len = inflater->Decompress(buffer, size);
+      }
+      catch (const util::RuntimeError& e)
+      {
+        throw util::net::NetworkError(e.Message());
+      }
+      
+      if (len > 0) return len;
+      if (inflater->Finished()) throw util::net::EndOfStream();
+      if (!inflater->NeedsInput()) continue;
+    }
+    
+    size_t len;
+    try
+    {
+      len = ReadRaw(inflater->Input(), inflater->InputSize());
+    }
+    catch (const util::net::EndOfStream&)
+    {
+      // connection closed before the end of the compressed stream,
+      // the upload must not be treated as complete
+      if (!inflater->Finished())
+        throw util::net::NetworkError("Compressed stream truncated");
+      throw;
+    }
+    
+    inflater->Supply(len);
+  }
+}
+
+size_t Data::ReadRaw(char* buffer, size_t size)
+{
+  SetNonBlocking(false);
+  CheckControl();
+  size_t len = socket.ReadNonBlocking(buffer, size);
+  if (len > 0) return len;
+  
+  WaitReadable();
+  return socket.Read(buffer, size);
+}
+
+size_t Data::Splice(int pipeFd, size_t count)
+{
+  assert(CanSplice());
+  SetNonBlocking(true);
+  CheckControl();
+  while (true)
+  {
+    try
+    {
+      return socket.Splice(pipeFd, count);
+    }
+    catch (const util::net::TimeoutError&)
+    {
+      // would have blocked, the wait has the real timeout
+    }
+    
+    WaitReadable();
+  }
+}
+
+void Data::WaitWriteable()
 {
   int pollTimeout = (socket.Timeout().Seconds() * 1000 ) + 
                     (socket.Timeout().Microseconds() / 1000);
@@ -345,22 +560,88 @@ void Data::Write(const char* buffer, size_t len)
     }
     
     if (fds[0].revents > 0) HandleControl(fds[0].revents);
-    if (fds[1].revents & POLLOUT)
-    {
-      socket.Write(buffer, len);
-      if (state.Type() == TransferType::List)
-        bytesWrite += len;
-      return;
-    }
+    // control activity alone, such as a STAT, doesn't affect the transfer
+    if (!fds[1].revents) continue;
+    if (fds[1].revents & POLLOUT) return;
     if (fds[1].revents & POLLHUP) throw util::net::EndOfStream();
     throw util::net::NetworkError();
   }
 }
 
+void Data::Write(const char* buffer, size_t len)
+{
+  if (!deflater) WriteRaw(buffer, len);
+  else
+  {
+    try
+    {
+      auto& output = deflater->Compress(buffer, len);
+      if (!output.empty()) WriteRaw(output.data(), output.size());
+    }
+    catch (...)
+    {
+      // don't try finishing the stream on a connection that's failed or aborted
+      deflater.reset();
+      throw;
+    }
+  }
+  
+  if (state.Type() == TransferType::List)
+    bytesWrite += len;
+}
+
+void Data::WriteRaw(const char* buffer, size_t len)
+{
+  SetNonBlocking(false);
+  CheckControl();
+  size_t written = socket.WriteNonBlocking(buffer, len);
+  if (written < len)
+  {
+    WaitWriteable();
+    socket.Write(buffer + written, len - written);
+  }
+}
+
+size_t Data::SendFile(int fd, off_t& offset, size_t count)
+{
+  assert(CanSendFile());
+  SetNonBlocking(true);
+  CheckControl();
+  while (true)
+  {
+    try
+    {
+      return socket.SendFile(fd, offset, count);
+    }
+    catch (const util::net::TimeoutError&)
+    {
+      // would have blocked, the wait has the real timeout
+    }
+    
+    WaitWriteable();
+  }
+}
+
+void Data::SetNonBlocking(bool nonBlocking)
+{
+  // sendfile and splice have no per call flag like MSG_DONTWAIT, so the
+  // socket is left non-blocking for as long as the transfer uses them
+  if (nonBlocking == this->nonBlocking) return;
+  socket.SetNonBlocking(nonBlocking);
+  this->nonBlocking = nonBlocking;
+}
+
 void Data::Interrupt()
 {
   socket.Shutdown();
-  listener.Shutdown();
+  
+  std::lock_guard<std::mutex> lock(listenerMutex);
+  if (listener)
+  {
+    // a shutdown listener is no use to the next session
+    listener->Discard();
+    listener->Listener().Shutdown();
+  }
 }
 
 
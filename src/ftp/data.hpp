@@ -2,12 +2,15 @@
 #define __FTP_DATA_HPP
 
 #include <memory>
+#include <mutex>
 #include <sys/types.h>
-#include "util/net/tcplistener.hpp"
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include "util/net/tcpsocket.hpp"
 #include "util/net/endpoint.hpp"
 #include "ftp/writeable.hpp"
 #include "ftp/transferstate.hpp"
+#include "ftp/portallocator.hpp"
+#include "ftp/passivepool.hpp"
 #include "util/enumstrings.hpp"
 
 namespace acl
@@ -48,28 +51,59 @@ enum class SSCNMode
   Client
 };
 
+enum class TransferMode
+{
+  Stream,
+  Deflate
+};
+
+class Deflater;
+class Inflater;
+
 class Data : public Writeable
 {
   Client& client;
-  util::net::TCPListener listener;
+  std::unique_ptr<PassiveListener> listener;
+  std::mutex listenerMutex;
   util::net::TCPSocket socket;
+  PortReservation socketPort;
   bool protection;
   PassiveType pasvType;
   util::net::Endpoint portEndpoint;
   ::ftp::EPSVMode epsvMode;
   ::ftp::DataType dataType;
   ::ftp::SSCNMode sscnMode;
+  ::ftp::TransferMode transferMode;
   off_t restartOffset;
+  off_t allocateSize;
   
   long long bytesRead;
   long long bytesWrite;
   
   TransferState state;
+  boost::posix_time::ptime nextControlCheck;
+  bool nonBlocking;
+  std::unique_ptr<Deflater> deflater;
+  std::unique_ptr<Inflater> inflater;
+  
+  // data socket is only polled along with the control socket
+  // when it isn't ready, otherwise control is checked this often
+  static const int controlCheckInterval = 100; // milliseconds
   
   void HandleControl(int revents);
+  void CheckControl();
+  void WaitReadable();
+  void WaitWriteable();
+  void SetNonBlocking(bool nonBlocking);
+  size_t ReadRaw(char* buffer, size_t size);
+  void WriteRaw(const char* buffer, size_t len);
+  void FinishCompression();
+  void ReleaseListener();
 
 public:
   explicit Data(Client& client);
+  ~Data();
+
   void SetProtection(bool protection) { this->protection = protection; }
   bool Protection() const { return protection; }
 
@@ -81,24 +115,46 @@ public:
   
   ::ftp::DataType DataType() const { return dataType; }
   void SetDataType(::ftp::DataType dataType) { this->dataType = dataType; }
+
+  ::ftp::TransferMode TransferMode() const { return transferMode; }
+  void SetTransferMode(::ftp::TransferMode transferMode) { this->transferMode = transferMode; }
   
   void SetRestartOffset(off_t restartOffset) { this->restartOffset = restartOffset; }
   off_t RestartOffset() const { return restartOffset; }
+
+  void SetAllocateSize(off_t allocateSize) { this->allocateSize = allocateSize; }
+  off_t AllocateSize() const { return allocateSize; }
   
   void InitPassive(util::net::Endpoint& ep, PassiveType pasvType);
   void InitActive(const util::net::Endpoint& ep);
   void Open(TransferType transferType);
   
-  void Close()
-  {
-    restartOffset = 0;
-    socket.Close();
-    state.Stop();
-  }
+  void Close();
   
   size_t Read(char* buffer, size_t size);
   void Write(const char* buffer, size_t len);
   
+  // binary transfers without TLS can have data passed
+  // between file and socket directly by the kernel,
+  // downloads can also when the kernel is doing the encryption
+  bool CanSendFile() const
+  { 
+    return dataType == ::ftp::DataType::Binary && 
+           transferMode == ::ftp::TransferMode::Stream &&
+           (!socket.IsTLS() || socket.IsKernelTLSSend()); 
+  }
+  
+  bool CanSplice() const
+  { 
+    return dataType == ::ftp::DataType::Binary && 
+           transferMode == ::ftp::TransferMode::Stream && 
+           !socket.IsTLS(); 
+  }
+  size_t SendFile(int fd, off_t& offset, size_t count);
+  size_t Splice(int pipeFd, size_t count);
+  
+  long RoundTripTime() const { return socket.RoundTripTime(); }
+  
   TransferState& State() { return state; }
   const TransferState& State() const { return state; }
   
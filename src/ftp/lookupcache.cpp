@@ -0,0 +1,181 @@
+#include "ftp/lookupcache.hpp"
+#include "util/net/resolver.hpp"
+#include "util/net/ipaddress.hpp"
+#include "util/net/error.hpp"
+#include "cfg/get.hpp"
+#include "logs/logs.hpp"
+#include "util/misc.hpp"
+
+namespace ftp
+{
+
+namespace pt = boost::posix_time;
+
+std::unique_ptr<LookupCache> LookupCache::instance;
+boost::once_flag LookupCache::instanceOnce = BOOST_ONCE_INIT;
+
+LookupCache::LookupCache() :
+  inserts(0),
+  shutdown(false)
+{
+  for (unsigned i = 0; i < resolverThreads; ++i)
+  {
+    resolvers.create_thread(std::bind(&LookupCache::Main, this));
+  }
+}
+
+void LookupCache::CreateInstance()
+{
+  instance.reset(new LookupCache());
+}
+
+LookupCache& LookupCache::Get()
+{
+  boost::call_once(&CreateInstance, instanceOnce);
+  return *instance;
+}
+
+bool LookupCache::Find(EntryMap& entries, const std::string& ip, std::string& value)
+{
+  auto it = entries.find(ip);
+  if (it == entries.end()) return false;
+
+  if (it->second.expires <= pt::second_clock::local_time())
+  {
+    entries.erase(it);
+    return false;
+  }
+
+  value = it->second.value;
+  return true;
+}
+
+void LookupCache::Insert(EntryMap& entries, const std::string& ip,
+                         const std::string& value, bool found)
+{
+  const cfg::Config& config = cfg::Get();
+  int ttl = found ? config.LookupCacheTTL() : config.LookupFailedTTL();
+  if (ttl <= 0) return;
+
+  auto now = pt::second_clock::local_time();
+  if (++inserts % pruneInterval == 0) Prune(now);
+
+  Entry& entry = entries[ip];
+  entry.value = value;
+  entry.expires = now + pt::seconds(ttl);
+}
+
+void LookupCache::Prune(const pt::ptime& now)
+{
+  for (auto* entries : { &hostnames, &identFailures })
+  {
+    for (auto it = entries->begin(); it != entries->end();)
+    {
+      if (it->second.expires <= now) it = entries->erase(it);
+      else ++it;
+    }
+  }
+}
+
+void LookupCache::Main()
+{
+  util::SetProcessTitle("RESOLVER");
+  
+  while (true)
+  {
+    std::pair<std::string, PromisePtr> lookup;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (queue.empty() && !shutdown) cond.wait(lock);
+      if (shutdown) break;
+      lookup = queue.front();
+      queue.pop();
+    }
+    
+    cfg::UpdateLocal();
+    Resolve(lookup.first, lookup.second);
+  }
+}
+
+void LookupCache::Shutdown()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (shutdown) return;
+    shutdown = true;
+    
+    for (; !queue.empty(); queue.pop())
+    {
+      resolving.erase(queue.front().first);
+      queue.front().second->set_value(queue.front().first);
+    }
+  }
+  
+  cond.notify_all();
+  resolvers.join_all();
+}
+
+void LookupCache::Resolve(const std::string& ip, const PromisePtr& promise)
+{
+  std::string hostname;
+  try
+  {
+    hostname = util::net::ReverseResolve(util::net::IPAddress(ip));
+  }
+  catch (const util::net::NetworkError&)
+  {
+    hostname = ip;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    resolving.erase(ip);
+    Insert(hostnames, ip, hostname, hostname != ip);
+  }
+
+  promise->set_value(hostname);
+}
+
+std::shared_future<std::string> LookupCache::Hostname(const std::string& ip)
+{
+  auto promise = std::make_shared<std::promise<std::string>>();
+  std::shared_future<std::string> future(promise->get_future());
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::string hostname;
+  if (Find(hostnames, ip, hostname))
+  {
+    promise->set_value(hostname);
+    return future;
+  }
+
+  auto it = resolving.find(ip);
+  if (it != resolving.end()) return it->second;
+
+  if (shutdown || queue.size() >= maximumQueued)
+  {
+    logs::Debug("Too many hostname lookups pending, not looking up %1%", ip);
+    promise->set_value(ip);
+    return future;
+  }
+
+  queue.push(std::make_pair(ip, promise));
+  resolving.insert(std::make_pair(ip, future));
+  cond.notify_one();
+  return future;
+}
+
+bool LookupCache::IdentFailed(const std::string& ip)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  std::string unused;
+  return Find(identFailures, ip, unused);
+}
+
+void LookupCache::SetIdentFailed(const std::string& ip)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  Insert(identFailures, ip, std::string(), false);
+}
+
+} /* ftp namespace */
@@ -0,0 +1,84 @@
+#ifndef __FTP_LOOKUPCACHE_HPP
+#define __FTP_LOOKUPCACHE_HPP
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <utility>
+#include <unordered_map>
+#include <condition_variable>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/once.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace ftp
+{
+
+// Hostname lookup results keyed by ip, so returning clients don't wait
+// on the resolver again until the entry expires. Failed lookups are
+// cached too, for a shorter time. Ident replies are only good for the
+// connection they were asked about, so only an ip's lack of a working
+// ident server is cached.
+//
+// Reverse lookups run on a small fixed pool of threads so a client can
+// do its ident lookup at the same time, and give up waiting without
+// stopping it. The result still goes into the cache when it does
+// arrive, and clients connecting from the same ip meanwhile share the
+// lookup. When the queue is full lookups fail straight away.
+
+class LookupCache
+{
+  struct Entry
+  {
+    std::string value;
+    boost::posix_time::ptime expires;
+  };
+
+  typedef std::unordered_map<std::string, Entry> EntryMap;
+  typedef std::shared_ptr<std::promise<std::string>> PromisePtr;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  EntryMap hostnames;
+  EntryMap identFailures;
+  std::unordered_map<std::string, std::shared_future<std::string>> resolving;
+  std::queue<std::pair<std::string, PromisePtr>> queue;
+  boost::thread_group resolvers;
+  unsigned inserts;
+  bool shutdown;
+
+  static const unsigned pruneInterval = 1024;
+  static const unsigned resolverThreads = 4;
+  static const size_t maximumQueued = 256;
+
+  LookupCache();
+
+  bool Find(EntryMap& entries, const std::string& ip, std::string& value);
+  void Insert(EntryMap& entries, const std::string& ip, const std::string& value, bool found);
+  void Prune(const boost::posix_time::ptime& now);
+  void Resolve(const std::string& ip, const PromisePtr& promise);
+  void Main();
+
+  static std::unique_ptr<LookupCache> instance;
+  static boost::once_flag instanceOnce;
+
+  static void CreateInstance();
+
+public:
+  std::shared_future<std::string> Hostname(const std::string& ip);
+  /* Result is the ip itself if it doesn't resolve */
+
+  bool IdentFailed(const std::string& ip);
+  void SetIdentFailed(const std::string& ip);
+  
+  void Shutdown();
+  /* Waits for lookups in progress, queued ones resolve to their ip */
+
+  static LookupCache& Get();
+};
+
+} /* ftp namespace */
+
+#endif
@@ -1,10 +1,14 @@
+#include <algorithm>
 #include <cstring>
+#include <cstdint>
+#include <new>
 #include <sstream>
 #include <fstream>
 #include "ftp/online.hpp"
 #include "ftp/client.hpp"
 #include "acl/user.hpp"
 #include "util/error.hpp"
+#include "logs/logs.hpp"
 #include "main.hpp"
 
 using namespace boost::interprocess;
@@ -14,13 +18,16 @@ namespace ftp
 
 namespace
 {
-long ThreadIdToLong(const boost::thread::id& tid)
+// readers give up on a slot stuck mid write, the server may have died
+// while updating it
+const int maxReadAttempts = 1000;
+
+template <size_t N>
+void CopyString(char (&dest)[N], const std::string& source)
 {
-  std::stringstream ss;
-  ss << tid;
-  long ltid;
-  ss >> std::hex >> ltid;
-  return ltid;
+  size_t len = std::min(source.length(), N - 1);
+  std::memcpy(dest, source.data(), len);
+  dest[len] = '\0';
 }
 }
 
@@ -48,13 +55,39 @@ OnlineClient::OnlineClient(
   strncpy(this->workDir, workDir.c_str(), sizeof(this->workDir));
 }
 
-OnlineData::OnlineData(boost::interprocess::managed_shared_memory& segment, int maxClients) :
-  clients(maxClients, std::hash<long>(), std::equal_to<long>(), segment.get_allocator<ShmOnlineMap::mapped_type>())
+void OnlineSlot::BeginWrite()
+{
+  sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void OnlineSlot::EndWrite()
 {
+  sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+bool OnlineSlot::Read(Storage& copy) const
+{
+  for (int attempt = 0; attempt < maxReadAttempts; ++attempt)
+  {
+    unsigned before = sequence.load(std::memory_order_acquire);
+    if (before & 1)
+    {
+      boost::this_thread::yield();
+      continue;
+    }
+
+    bool wasOnline = online.load(std::memory_order_relaxed);
+    if (wasOnline) std::memcpy(&copy, &client, sizeof(client));
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sequence.load(std::memory_order_relaxed) == before) return wasOnline;
+  }
+  return false;
 }
 
 OnlineWriter::OnlineWriter(const std::string& id, int maxClients) :
-  id(id), data(nullptr)
+  id(id), slots(nullptr), numSlots(0)
 {
   OpenSharedMemory(maxClients);
 }
@@ -63,13 +96,13 @@ void OnlineWriter::OpenSharedMemory(int maxClients)
 {  
   try
   {
-    segment.reset(new managed_shared_memory(open_or_create, id.c_str(), clientSize * (maxClients + 1)));
+    segment.reset(new managed_shared_memory(open_or_create, id.c_str(), slotSize * (maxClients + 1)));
 
-    segment->construct<OnlineData>("online")(*segment, maxClients);
-    data = segment->find<OnlineData>("online").first;
-    if (!data) throw util::SystemError(ENOMEM);
-    scoped_lock<interprocess_mutex> lock(data->mutex);
-    data->clients.clear();
+    segment->construct<OnlineSlot>("online")[maxClients]();
+    auto found = segment->find<OnlineSlot>("online");
+    if (!found.first) throw util::SystemError(ENOMEM);
+    slots = found.first;
+    numSlots = found.second;
   }
   catch (const interprocess_exception& e)
   {
@@ -83,119 +116,123 @@ OnlineWriter::~OnlineWriter()
   shared_memory_object::remove(id.c_str());
 }
 
-void OnlineWriter::LoggedIn(long tid, Client& client, const std::string& workDir)
-{
-  scoped_lock<interprocess_mutex> lock(data->mutex);
-  data->clients.insert(std::make_pair(tid, OnlineClient(client.User().ID(), client.Ident(), 
-              client.IP(), client.Hostname(), workDir)));  
-}
-
-void OnlineWriter::LoggedIn(const boost::thread::id& tid, Client& client, const std::string& workDir)
-{
-  LoggedIn(ThreadIdToLong(tid), client, workDir);
-}
-
-void OnlineWriter::LoggedOut(long tid)
+int OnlineWriter::LoggedIn(Client& client, const std::string& workDir)
 {
-  scoped_lock<interprocess_mutex> lock(data->mutex);
-  data->clients.erase(tid);
-}
+  OnlineClient online(client.User().ID(), client.Ident(), 
+                      client.IP(), client.Hostname(), workDir);
 
-void OnlineWriter::LoggedOut(const boost::thread::id& tid)
-{
-  LoggedOut(ThreadIdToLong(tid));
-}
-
-void OnlineWriter::Command(long tid, const std::string& command)
-{
-  scoped_lock<interprocess_mutex> lock(data->mutex);
-  auto it = data->clients.find(tid);
-  verify(it != data->clients.end());
-  strncpy(it->second.command, command.c_str(), sizeof(it->second.command));
+  for (int slot = 0; slot < numSlots; ++slot)
+  {
+    bool claimed = false;
+    if (slots[slot].claimed.compare_exchange_strong(claimed, true, std::memory_order_acquire))
+    {
+      Update(slot, [&](OnlineClient& data)
+             {
+               new (&data) OnlineClient(online);
+               slots[slot].online.store(true, std::memory_order_relaxed);
+             });
+      return slot;
+    }
+  }
+  
+  logs::Error("No free online slot for %1%, session will not appear in online listings",
+              client.User().Name());
+  return -1;
 }
 
-void OnlineWriter::Command(const boost::thread::id& tid, const std::string& command)
+void OnlineWriter::LoggedOut(int slot)
 {
-  Command(ThreadIdToLong(tid), command);
+  if (slot < 0) return;
+  Update(slot, [&](OnlineClient&) { slots[slot].online.store(false, std::memory_order_relaxed); });
+  slots[slot].claimed.store(false, std::memory_order_release);
 }
 
-void OnlineWriter::Idle(long tid)
+void OnlineWriter::Command(int slot, const std::string& command)
 {
-  scoped_lock<interprocess_mutex> lock(data->mutex);
-  auto it = data->clients.find(tid);
-  verify(it != data->clients.end());
-  it->second.command[0] = '\0';
-  it->second.lastCommand = boost::posix_time::second_clock::local_time();
+  Update(slot, [&](OnlineClient& data) { CopyString(data.command, command); });
 }
 
-void OnlineWriter::Idle(const boost::thread::id& tid)
+void OnlineWriter::Idle(int slot)
 {
-  Idle(ThreadIdToLong(tid));
+  auto now = boost::posix_time::second_clock::local_time();
+  Update(slot, [&](OnlineClient& data)
+         {
+           data.command[0] = '\0';
+           data.lastCommand = now;
+         });
 }
 
-void OnlineWriter::StartTransfer(long tid, stats::Direction direction, 
+void OnlineWriter::StartTransfer(int slot, stats::Direction direction, 
                                  const boost::posix_time::ptime& start)
 {
-  scoped_lock<interprocess_mutex> lock(data->mutex);
-  auto it = data->clients.find(tid);
-  verify(it != data->clients.end());
-  it->second.xfer.reset(OnlineXfer(direction, start));
+  Update(slot, [&](OnlineClient& data) { data.xfer.reset(OnlineXfer(direction, start)); });
 }
 
-void OnlineWriter::TransferUpdate(long tid, long long bytes)
+void OnlineWriter::TransferUpdate(int slot, long long bytes)
 {
-  scoped_lock<interprocess_mutex> lock(data->mutex);
-  auto it = data->clients.find(tid);
-  verify(it != data->clients.end());
-  assert(it->second.xfer);
-  it->second.xfer->bytes = bytes;
+  Update(slot, [&](OnlineClient& data)
+         {
+           assert(data.xfer);
+           data.xfer->bytes = bytes;
+         });
 }
 
-void OnlineWriter::StopTransfer(long tid)
+void OnlineWriter::StopTransfer(int slot)
 {
-  scoped_lock<interprocess_mutex> lock(data->mutex);
-  auto it = data->clients.find(tid);
-  verify(it != data->clients.end());
-  assert(it->second.xfer);
-  it->second.xfer = boost::none;
+  Update(slot, [&](OnlineClient& data)
+         {
+           assert(data.xfer);
+           data.xfer = boost::none;
+         });
 }
 
-OnlineReaderIterator::OnlineReaderIterator(const OnlineReader* const reader) :
-  reader(reader)
+OnlineReaderIterator::OnlineReaderIterator(const OnlineReader* const reader, int slot) :
+  reader(reader), slot(slot)
 {
-  if (reader && reader->data) iter.reset(reader->data->clients.begin());
+  if (slot < reader->numSlots) Next();
 }
 
-OnlineReaderIterator::OnlineReaderIterator(const OnlineReader* const reader, bool /* end */) :
-  reader(reader)
+void OnlineReaderIterator::Next()
 {
-  if (reader && reader->data) iter.reset(reader->data->clients.end());
+  OnlineSlot::Storage copy;
+  for (; slot < reader->numSlots; ++slot)
+  {
+    if (reader->slots[slot].Read(copy))
+    {
+      client.reset(*reinterpret_cast<const OnlineClient*>(&copy));
+      return;
+    }
+  }
+  client = boost::none;
 }
 
 OnlineReaderIterator& OnlineReaderIterator::operator++()
 {
-  client = boost::none;
-  verify(iter && reader && reader->locked);
-  ++(*iter);
+  verify(slot < reader->numSlots);
+  ++slot;
+  Next();
   return *this;
 }
 
 OnlineReaderIterator OnlineReaderIterator::operator++(int)
 {
-  client = boost::none;
-  verify(iter && reader && reader->locked);
   OnlineReaderIterator temp(*this);
-  ++(*iter);
+  operator++();
   return temp;
 }
 
 OnlineReader::OnlineReader(const std::string& id) :    
-  data(nullptr), locked(false)
+  slots(nullptr), numSlots(0)
 {
   try
   {
     segment.reset(new managed_shared_memory(open_only, id.c_str()));
-    data = segment->find<OnlineData>("online").first;
+    auto found = segment->find<OnlineSlot>("online");
+    if (found.first)
+    {
+      slots = found.first;
+      numSlots = found.second;
+    }
   }
   catch (const boost::interprocess::interprocess_exception& e)
   {
@@ -203,59 +240,28 @@ OnlineReader::OnlineReader(const std::string& id) :
   }
 }
 
-OnlineReader::~OnlineReader()
-{
-  segment = nullptr;
-  shared_memory_object::remove(id.c_str());
-}
-
 OnlineReaderIterator OnlineReader::begin() const
 {
-  verify(locked);
-  return OnlineReaderIterator(this);
+  return OnlineReaderIterator(this, 0);
 }
 
 OnlineReaderIterator OnlineReader::end() const
 {
-  verify(locked);
-  return OnlineReaderIterator(this, true);
-}
-
-OnlineReader::size_type OnlineReader::size() const
-{
-  if (!data) return 0;
-  if (locked) return data->clients.size();
-  else
-  {
-    scoped_lock<interprocess_mutex> lock(data->mutex);
-    return data->clients.size();
-  }
-}
-
-void OnlineReader::Lock() const
-{
-  locked = true;
-  if (data) data->mutex.lock();
-}
-
-void OnlineReader::Unlock() const
-{
-  locked = false;
-  if (data) data->mutex.unlock();
+  return OnlineReaderIterator(this, numSlots);
 }
 
 OnlineTransferUpdater::OnlineTransferUpdater(
-        const boost::thread::id& tid, stats::Direction direction,
+        const Client& client, stats::Direction direction,
         const boost::posix_time::ptime& start) :
-  tid(ThreadIdToLong(tid)),
+  slot(client.OnlineSlot()),
   nextUpdate(start)
 {
-  OnlineWriter::Get().StartTransfer(this->tid, direction, start);
+  OnlineWriter::Get().StartTransfer(slot, direction, start);
 }
 
 OnlineTransferUpdater::~OnlineTransferUpdater()
 {
-  OnlineWriter::Get().StopTransfer(tid);
+  OnlineWriter::Get().StopTransfer(slot);
 }
 
 std::string SharedMemoryID(pid_t pid)
@@ -1,14 +1,11 @@
 #include <iterator>
-#include <boost/interprocess/sync/interprocess_mutex.hpp>
-#include <boost/interprocess/sync/scoped_lock.hpp>
-#include <boost/interprocess/segment_manager.hpp>
+#include <atomic>
+#include <cassert>
+#include <type_traits>
 #include <boost/interprocess/managed_shared_memory.hpp>
-#include <boost/interprocess/containers/map.hpp>
-#include <boost/interprocess/allocators/allocator.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/optional.hpp>
-#include <boost/unordered_map.hpp>
 #include <limits.h>
 #if defined(__FreeBSD__)
 #include <sys/param.h>
@@ -55,17 +52,26 @@ struct OnlineClient
   bool IsIdle() const { return command[0] == '\0'; }
 };
 
-typedef boost::interprocess::managed_shared_memory::segment_manager SegmentManager;
-typedef boost::interprocess::allocator<std::pair<const long, OnlineClient>, 
-                                       SegmentManager> ShmOnlineMapAlloc;
-typedef boost::unordered_map<long, OnlineClient, std::hash<long>, std::equal_to<long>, ShmOnlineMapAlloc> ShmOnlineMap;
-
-struct OnlineData
+// Sessions each claim a slot at login and are the only writer to it, the
+// sequence is odd while a write is in progress. Readers copy a slot and
+// retry if the sequence was odd or moved while copying, so listing who's
+// online never blocks a session and sessions never block each other.
+struct OnlineSlot
 {
-  ShmOnlineMap clients;
-  boost::interprocess::interprocess_mutex mutex;
-  
-  OnlineData(boost::interprocess::managed_shared_memory& segment, int maxClients);
+  typedef std::aligned_storage<sizeof(OnlineClient), alignof(OnlineClient)>::type Storage;
+
+  std::atomic<bool> claimed;
+  std::atomic<unsigned> sequence;
+  std::atomic<bool> online;
+  Storage client;
+
+  OnlineSlot() : claimed(false), sequence(0), online(false) { }
+
+  OnlineClient& Data() { return *reinterpret_cast<OnlineClient*>(&client); }
+
+  void BeginWrite();
+  void EndWrite();
+  bool Read(Storage& copy) const;
 };
 
 class Client;
@@ -75,31 +81,39 @@ class OnlineWriter
 {
   std::string id;
   std::unique_ptr<boost::interprocess::managed_shared_memory> segment;
-  OnlineData* data;
+  OnlineSlot* slots;
+  int numSlots;
 
 	static std::unique_ptr<OnlineWriter> instance;
-  constexpr static float clientOverhead = 0.02;
-  constexpr static size_t clientSize = sizeof(OnlineClient) * (1 + clientOverhead);
+  constexpr static float slotOverhead = 0.02;
+  constexpr static size_t slotSize = sizeof(OnlineSlot) * (1 + slotOverhead);
 
   OnlineWriter(const std::string& id, int maxClients);
   void OpenSharedMemory(int maxClients);
 
-  void LoggedIn(long tid, Client& client, const std::string& workDir);
-	void LoggedOut(long tid);
-	void Command(long tid, const std::string& command);
-	void Idle(long tid);
+  template <typename Function>
+  void Update(int slot, Function function)
+  {
+    if (slot < 0) return;
+    assert(slot < numSlots);
+    slots[slot].BeginWrite();
+    function(slots[slot].Data());
+    slots[slot].EndWrite();
+  }
 
-	void StartTransfer(long tid, stats::Direction direction, const boost::posix_time::ptime& start);
-	void TransferUpdate(long tid, long long bytes);
-	void StopTransfer(long tid);
+	void StartTransfer(int slot, stats::Direction direction, const boost::posix_time::ptime& start);
+	void TransferUpdate(int slot, long long bytes);
+	void StopTransfer(int slot);
   
 public:
   ~OnlineWriter();
   
-  void LoggedIn(const boost::thread::id& tid, Client& client, const std::string& workDir);
-	void LoggedOut(const boost::thread::id& tid);
-	void Command(const boost::thread::id& tid, const std::string& command);
-	void Idle(const boost::thread::id& tid);
+  int LoggedIn(Client& client, const std::string& workDir);
+  /* Returns the slot claimed for the session, or -1 if none are free */
+  
+	void LoggedOut(int slot);
+	void Command(int slot, const std::string& command);
+	void Idle(int slot);
   
 	static void Initialise(const std::string& id, int maxClients)
   {
@@ -116,17 +130,16 @@ public:
   friend class OnlineTransferUpdater;
 };
 
-class OnlineReaderLock;
 class OnlineReader;
 
 class OnlineReaderIterator : public std::iterator<std::forward_iterator_tag, OnlineClient>
 {
   const OnlineReader* const reader;
-  boost::optional<ShmOnlineMap::iterator> iter;
-  mutable boost::optional<OnlineClient> client;
+  int slot;
+  boost::optional<OnlineClient> client;
     
-  OnlineReaderIterator(const OnlineReader* const reader, bool end); 
-  OnlineReaderIterator(const OnlineReader* const reader);
+  OnlineReaderIterator(const OnlineReader* const reader, int slot);
+  void Next();
   
 public:
     
@@ -135,9 +148,7 @@ public:
   
   bool operator==(const OnlineReaderIterator& rhs) const
   {
-    if (!iter && !rhs.iter) return true;
-    verify(iter);
-    return *iter == *rhs.iter;
+    return slot == rhs.slot;
   }
   
   bool operator!=(const OnlineReaderIterator& rhs) const
@@ -147,83 +158,48 @@ public:
   
   const OnlineClient& operator*() const
   {
-    if (!client) client.reset((*iter)->second);
+    verify(client);
     return *client;
   }
 
   const OnlineClient* operator->() const
   {
-    if (!client) client.reset((*iter)->second);
+    verify(client);
     return &*client;
   }
   
   friend class OnlineReader;
 };
 
+// Each client is a consistent copy taken as the iterator reaches it, no
+// lock is held so the list as a whole is not a single point in time.
 class OnlineReader
 {
-  std::string id;
   std::unique_ptr<boost::interprocess::managed_shared_memory> segment;
-  OnlineData* data;
-  mutable bool locked;
-  
-  void Lock() const;
-  void Unlock() const;
+  const OnlineSlot* slots;
+  int numSlots;
   
 public:
   typedef OnlineReaderIterator const_iterator;
   typedef OnlineClient value_type;
-  typedef ShmOnlineMap::size_type size_type;
 
   OnlineReader(const std::string& id);
-  ~OnlineReader();
   
   OnlineReaderIterator begin() const;
   OnlineReaderIterator end() const;
-  
-  size_type size() const;
 
-  friend class OnlineReaderLock;
   friend class OnlineReaderIterator;
 };
 
-class OnlineReaderLock
-{
-  const OnlineReader& reader;
-  bool released;
-  
-public:
-  OnlineReaderLock(const OnlineReader& reader) :
-    reader(reader), released(false)
-  {
-    reader.Lock();
-  }
-  
-  ~OnlineReaderLock()
-  {
-    if (!released)
-    {
-      reader.Unlock();
-    }
-  }
-  
-  void Release()
-  {
-    verify(!released);
-    reader.Unlock();
-    released = true;
-  }
-};
-
 class OnlineTransferUpdater
 {
-  long tid;
+  int slot;
   boost::posix_time::ptime nextUpdate;
   
   static boost::posix_time::milliseconds interval;
   
 public:
-  OnlineTransferUpdater(const boost::thread::id& tid, stats::Direction direction,
+  OnlineTransferUpdater(const Client& client, stats::Direction direction,
                         const boost::posix_time::ptime& start);
   
   ~OnlineTransferUpdater();
@@ -233,7 +209,7 @@ public:
     auto now = boost::posix_time::microsec_clock::local_time();
     if (now >= nextUpdate)
     {
-      OnlineWriter::Get().TransferUpdate(tid, bytes);
+      OnlineWriter::Get().TransferUpdate(slot, bytes);
       nextUpdate = now + interval;
     }
   }
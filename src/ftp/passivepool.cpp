@@ -0,0 +1,72 @@
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "ftp/passivepool.hpp"
+#include "util/net/ipaddress.hpp"
+#include "cfg/get.hpp"
+
+namespace ftp
+{
+
+std::unique_ptr<PassivePool> PassivePool::instance;
+boost::once_flag PassivePool::instanceOnce = BOOST_ONCE_INIT;
+
+void PassivePool::CreateInstance()
+{
+  instance.reset(new PassivePool());
+}
+
+PassivePool& PassivePool::Get()
+{
+  boost::call_once(&CreateInstance, instanceOnce);
+  return *instance;
+}
+
+void PassivePool::Drain(util::net::TCPListener& listener)
+{
+  struct pollfd pfd;
+  pfd.fd = listener.Socket();
+  pfd.events = POLLIN;
+
+  while (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN))
+  {
+    int fd = accept4(listener.Socket(), nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      break;
+    }
+    close(fd);
+  }
+}
+
+std::unique_ptr<PassiveListener> PassivePool::Borrow(const util::net::IPAddress& ip)
+{
+  std::unique_ptr<PassiveListener> listener;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = idle.find(ip.ToString());
+    if (it == idle.end() || it->second.empty()) return nullptr;
+
+    listener = std::move(it->second.back());
+    it->second.pop_back();
+  }
+
+  Drain(listener->Listener());
+  return listener;
+}
+
+void PassivePool::Return(std::unique_ptr<PassiveListener> listener)
+{
+  if (!listener->Pooled() || !listener->Listener().IsListening()) return;
+
+  Drain(listener->Listener());
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& listeners = idle[listener->Listener().Endpoint().IP().ToString()];
+  if (static_cast<int>(listeners.size()) < cfg::Get().PasvPool())
+    listeners.emplace_back(std::move(listener));
+}
+
+} /* ftp namespace */
@@ -0,0 +1,71 @@
+#ifndef __FTP_PASSIVEPOOL_HPP
+#define __FTP_PASSIVEPOOL_HPP
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <boost/thread/once.hpp>
+#include "util/net/tcplistener.hpp"
+#include "ftp/portallocator.hpp"
+
+namespace util { namespace net
+{
+class IPAddress;
+}
+}
+
+namespace ftp
+{
+
+// Passive listener along with the port reserved for it, port is
+// declared first so it isn't released until the socket is closed
+
+class PassiveListener
+{
+  PortReservation port;
+  util::net::TCPListener listener;
+  bool pooled;
+
+public:
+  explicit PassiveListener(bool pooled) : pooled(pooled) { }
+
+  util::net::TCPListener& Listener() { return listener; }
+  PortReservation& Port() { return port; }
+
+  bool Pooled() const { return pooled; }
+  void Discard() { pooled = false; }
+};
+
+// Idle passive listeners kept open between transfers so sessions
+// moving lots of small files don't pay for socket, bind and listen
+// on every PASV. Connections queued on a listener while it isn't
+// borrowed are dropped, they can't belong to the next session.
+
+class PassivePool
+{
+  typedef std::vector<std::unique_ptr<PassiveListener>> ListenerVector;
+
+  std::mutex mutex;
+  std::unordered_map<std::string, ListenerVector> idle;
+
+  PassivePool() = default;
+
+  static void Drain(util::net::TCPListener& listener);
+
+  static std::unique_ptr<PassivePool> instance;
+  static boost::once_flag instanceOnce;
+
+  static void CreateInstance();
+
+public:
+  std::unique_ptr<PassiveListener> Borrow(const util::net::IPAddress& ip);
+  void Return(std::unique_ptr<PassiveListener> listener);
+
+  static PassivePool& Get();
+};
+
+} /* ftp namespace */
+
+#endif
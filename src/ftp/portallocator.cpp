@@ -0,0 +1,104 @@
+#include "ftp/portallocator.hpp"
+
+namespace ftp
+{
+
+const int PortAllocatorImpl::noPort;
+
+PortAllocatorImpl::PortAllocatorImpl() :
+  nextPort(0)
+{
+  available.fill(0);
+  summary.fill(0);
+}
+
+void PortAllocatorImpl::SetAvailable(int port)
+{
+  int word = port / wordBits;
+  available[word] |= 1ULL << (port % wordBits);
+  summary[word / wordBits] |= 1ULL << (word % wordBits);
+}
+
+void PortAllocatorImpl::ClearAvailable(int port)
+{
+  int word = port / wordBits;
+  available[word] &= ~(1ULL << (port % wordBits));
+  if (!available[word]) summary[word / wordBits] &= ~(1ULL << (word % wordBits));
+}
+
+// first word at or after word with an available port in it, -1 if none
+int PortAllocatorImpl::FindWord(int word) const
+{
+  if (word >= numWords) return -1;
+
+  int index = word / wordBits;
+  uint64_t bits = summary[index] & (~0ULL << (word % wordBits));
+  while (!bits)
+  {
+    if (++index == numSummaryWords) return -1;
+    bits = summary[index];
+  }
+
+  return index * wordBits + __builtin_ctzll(bits);
+}
+
+int PortAllocatorImpl::FindAvailable(int from) const
+{
+  int word = from / wordBits;
+  uint64_t bits = available[word] & (~0ULL << (from % wordBits));
+  if (bits) return word * wordBits + __builtin_ctzll(bits);
+
+  word = FindWord(word + 1);
+  if (word < 0) word = FindWord(0);  // wrap around
+  if (word < 0) return noPort;
+
+  return word * wordBits + __builtin_ctzll(available[word]);
+}
+
+void PortAllocatorImpl::SetPorts(const cfg::Ports& ports)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  this->ports = ports;
+
+  configured.reset();
+  available.fill(0);
+  summary.fill(0);
+
+  for (const auto& range : this->ports.Ranges())
+  {
+    for (int port = range.From(); port <= range.To(); ++port)
+    {
+      configured.set(port);
+      // ports still held from before a reload aren't handed out twice
+      if (!inUse.test(port)) SetAvailable(port);
+    }
+  }
+
+  nextPort = this->ports.Ranges().empty() ? 0 : this->ports.Ranges().front().From();
+}
+
+int PortAllocatorImpl::NextPort()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (ports.Ranges().empty()) return util::net::Endpoint::AnyPort();
+
+  int port = FindAvailable(nextPort);
+  if (port == noPort) return noPort;
+
+  ClearAvailable(port);
+  inUse.set(port);
+  nextPort = (port + 1) % numPorts;
+  return port;
+}
+
+void PortAllocatorImpl::Release(int port)
+{
+  if (port <= 0) return;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  assert(inUse.test(port));
+  inUse.reset(port);
+  if (configured.test(port)) SetAvailable(port);
+}
+
+} /* ftp namespace */
@@ -3,8 +3,11 @@
 
 #include <memory>
 #include <cassert>
-#include <vector>
+#include <cstdint>
+#include <array>
+#include <bitset>
 #include <mutex>
+#include <boost/noncopyable.hpp>
 #include <boost/thread/once.hpp>
 #include "util/net/endpoint.hpp"
 #include "cfg/get.hpp"
@@ -21,42 +24,43 @@ enum class PortType
 template <PortType type>
 class PortAllocator;
 
+// Ports are handed out round robin from a bitmap of those that are
+// configured and not currently held by this process. A second level
+// bitmap marks which words have a free port in them so finding the
+// next one takes a fixed number of steps however full the ranges are.
+
 class PortAllocatorImpl
 {
+  static const int numPorts = 65536;
+  static const int wordBits = 64;
+  static const int numWords = numPorts / wordBits;
+  static const int numSummaryWords = numWords / wordBits;
+
   std::mutex mutex;
   cfg::Ports ports;
-  std::vector<cfg::PortRange>::const_iterator it;
+  std::bitset<numPorts> configured;
+  std::bitset<numPorts> inUse;
+  std::array<uint64_t, numWords> available;
+  std::array<uint64_t, numSummaryWords> summary;
   int nextPort;
-  
-  PortAllocatorImpl() : nextPort(0) { }
-  
+
+  PortAllocatorImpl();
+
+  void SetAvailable(int port);
+  void ClearAvailable(int port);
+  int FindWord(int word) const;
+  int FindAvailable(int from) const;
+
 public:
-  void SetPorts(const cfg::Ports& ports)
-  {
-    std::lock_guard<std::mutex> lock(mutex);
-    this->ports = ports;
-    it = this->ports.Ranges().begin();
-  }
+  static const int noPort = -1;
+
+  void SetPorts(const cfg::Ports& ports);
+
+  int NextPort();
+  /* Returns AnyPort when no ranges are configured, noPort when all are in use */
+
+  void Release(int port);
 
-  int inline NextPort()
-  {
-    std::lock_guard<std::mutex> lock(mutex);
-    if (ports.Ranges().empty()) return util::net::Endpoint::AnyPort();
-    if (!nextPort) 
-    {
-      nextPort = it->From();
-      return nextPort++;
-    }
-    
-    while (true)
-    {
-      if (nextPort <= it->To()) return nextPort++;
-      if (++it == ports.Ranges().end())
-        it = ports.Ranges().begin();
-      nextPort = it->From();
-    }
-  }
-  
   friend class PortAllocator<PortType::Active>;
   friend class PortAllocator<PortType::Passive>;
 };
@@ -66,9 +70,9 @@ class PortAllocator
 {
   static std::unique_ptr<PortAllocatorImpl> instance;
   static boost::once_flag instanceOnce;
-  
+
   static void CreateInstance() { instance.reset(new PortAllocatorImpl()); }
-  
+
 public:
   static PortAllocatorImpl& Get()
   {
@@ -85,6 +89,33 @@ boost::once_flag PortAllocator<type>::instanceOnce = BOOST_ONCE_INIT;
 template class PortAllocator<PortType::Passive>;
 template class PortAllocator<PortType::Active>;
 
+// Holds an allocated port until the socket bound to it is closed
+
+class PortReservation : boost::noncopyable
+{
+  PortAllocatorImpl* allocator;
+  int port;
+
+public:
+  PortReservation() : allocator(nullptr), port(PortAllocatorImpl::noPort) { }
+  ~PortReservation() { Release(); }
+
+  void Reset(PortAllocatorImpl& allocator, int port)
+  {
+    Release();
+    this->allocator = &allocator;
+    this->port = port;
+  }
+
+  void Release()
+  {
+    if (!allocator) return;
+    allocator->Release(port);
+    allocator = nullptr;
+    port = PortAllocatorImpl::noPort;
+  }
+};
+
 inline void InitialisePortAllocators()
 {
   cfg::ConnectUpdatedSlot([]() { PortAllocator<ftp::PortType::Active>::Get().SetPorts(cfg::Get().ActivePorts()); });
@@ -0,0 +1,170 @@
+#include <cerrno>
+#include <algorithm>
+#include <cassert>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <boost/thread/thread.hpp>
+#include "ftp/reactor.hpp"
+#include "ftp/task/task.hpp"
+#include "logs/logs.hpp"
+#include "util/error.hpp"
+#include "util/misc.hpp"
+
+namespace ftp
+{
+
+std::unique_ptr<Reactor> Reactor::instance;
+boost::once_flag Reactor::instanceOnce = BOOST_ONCE_INIT;
+
+Reactor::Reactor() :
+  epollFd(epoll_create1(EPOLL_CLOEXEC)),
+  shutdown(false)
+{
+  if (epollFd < 0)
+  {
+    logs::Error("Unable to create epoll instance, idle sessions won't be parked: %1%",
+                util::Error::Failure(errno).Message());
+    return;
+  }
+
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = nullptr;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, interruptPipe.ReadFd(), &event) < 0)
+  {
+    logs::Error("Unable to watch reactor interrupt pipe, idle sessions won't be parked: %1%",
+                util::Error::Failure(errno).Message());
+    close(epollFd);
+    epollFd = -1;
+  }
+}
+
+Reactor::~Reactor()
+{
+  if (epollFd >= 0) close(epollFd);
+}
+
+void Reactor::CreateInstance()
+{
+  instance.reset(new Reactor());
+}
+
+Reactor& Reactor::Get()
+{
+  boost::call_once(&CreateInstance, instanceOnce);
+  return *instance;
+}
+
+void Reactor::StartThread()
+{
+  if (epollFd < 0) return;
+  logs::Debug("Starting session reactor thread..");
+  Start();
+}
+
+void Reactor::Shutdown()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (shutdown) return;
+    shutdown = true;
+  }
+
+  logs::Debug("Stopping session reactor thread..");
+  interruptPipe.Interrupt();
+  Join();
+}
+
+bool Reactor::Park(Client& client, int fd, const boost::posix_time::ptime* expires)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (shutdown || !Started()) return false;
+
+  assert(parked.find(&client) == parked.end());
+
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+  event.data.ptr = &client;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0)
+  {
+    logs::Error("Unable to park idle session: %1%", util::Error::Failure(errno).Message());
+    return false;
+  }
+
+  auto it = parked.insert(std::make_pair(&client, Parked(fd))).first;
+  if (expires)
+  {
+    it->second.expiry.reset(expiries.insert(std::make_pair(*expires, &client)));
+
+    // reactor thread may be sleeping past our expiry time
+    if (expiries.begin() == *it->second.expiry) interruptPipe.Interrupt();
+  }
+
+  return true;
+}
+
+void Reactor::Wake(Client* client)
+{
+  auto it = parked.find(client);
+  if (it == parked.end()) return;
+
+  if (epoll_ctl(epollFd, EPOLL_CTL_DEL, it->second.fd, nullptr) < 0)
+  {
+    logs::Error("Unable to remove parked session from reactor: %1%",
+                util::Error::Failure(errno).Message());
+  }
+
+  if (it->second.expiry) expiries.erase(*it->second.expiry);
+  parked.erase(it);
+
+  std::make_shared<task::ResumeClient>(*client)->Push();
+}
+
+int Reactor::NextTimeout()
+{
+  if (expiries.empty()) return -1;
+  auto remaining = expiries.begin()->first - boost::posix_time::microsec_clock::local_time();
+  // round up so we don't wake a fraction of a millisecond too early
+  return std::max<long>(0, remaining.total_milliseconds() + 1);
+}
+
+void Reactor::Run()
+{
+  util::SetProcessTitle("REACTOR");
+
+  struct epoll_event events[maxEvents];
+  while (true)
+  {
+    int timeout;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (shutdown) break;
+      timeout = NextTimeout();
+    }
+
+    int n = epoll_wait(epollFd, events, maxEvents, timeout);
+    if (n < 0)
+    {
+      if (errno == EINTR) continue;
+      logs::Error("Session reactor wait failed: %1%", util::Error::Failure(errno).Message());
+      // ensure we don't spin on repeated failures
+      boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+      continue;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int i = 0; i < n; ++i)
+    {
+      if (!events[i].data.ptr) interruptPipe.Acknowledge();
+      else Wake(static_cast<Client*>(events[i].data.ptr));
+    }
+
+    auto now = boost::posix_time::microsec_clock::local_time();
+    while (!expiries.empty() && expiries.begin()->first <= now)
+    {
+      Wake(expiries.begin()->second);
+    }
+  }
+}
+
+} /* ftp namespace */
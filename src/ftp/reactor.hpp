@@ -0,0 +1,70 @@
+#ifndef __FTP_REACTOR_HPP
+#define __FTP_REACTOR_HPP
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <boost/optional.hpp>
+#include <boost/thread/once.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "util/thread.hpp"
+#include "util/interruptpipe.hpp"
+
+namespace ftp
+{
+
+class Client;
+
+// Idle control sessions are parked here so they don't hold on to a thread
+// while waiting for their next command. A single thread watches every
+// parked control socket and asks the listener thread to resume the session
+// when a command arrives or its idle timeout expires.
+
+class Reactor : public util::Thread
+{
+  typedef std::multimap<boost::posix_time::ptime, Client*> ExpiryMap;
+
+  struct Parked
+  {
+    int fd;
+    boost::optional<ExpiryMap::iterator> expiry;
+
+    Parked(int fd) : fd(fd) { }
+  };
+
+  int epollFd;
+  util::InterruptPipe interruptPipe;
+  std::mutex mutex;
+  std::unordered_map<Client*, Parked> parked;
+  ExpiryMap expiries;
+  bool shutdown;
+
+  static const int maxEvents = 64;
+
+  Reactor();
+
+  void Run();
+  int NextTimeout();
+  void Wake(Client* client);
+
+  static std::unique_ptr<Reactor> instance;
+  static boost::once_flag instanceOnce;
+
+  static void CreateInstance();
+
+public:
+  ~Reactor();
+
+  bool Park(Client& client, int fd, const boost::posix_time::ptime* expires);
+
+  void StartThread();
+  void Shutdown();
+
+  static Reactor& Get();
+};
+
+} /* ftp namespace */
+
+#endif
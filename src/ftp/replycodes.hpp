@@ -10,6 +10,7 @@ enum ReplyCode
   CodeNotSet = -1,
   NoCode = 0,
   CommandOkay = 200,
+  CommandSuperfluous = 202,
   ServiceReady = 220,
   CommandUnrecognised = 500,
   SyntaxError = 501,
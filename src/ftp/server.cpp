@@ -1,13 +1,20 @@
 #include <csignal>
 #include <cassert>
+#include <cerrno>
 #include <memory>
+#include <algorithm>
 #include <boost/thread/thread.hpp>
 #include <poll.h>
 #include "ftp/server.hpp"
 #include "ftp/client.hpp"
+#include "ftp/reactor.hpp"
+#include "ftp/sessionpool.hpp"
+#include "ftp/admission.hpp"
+#include "ftp/lookupcache.hpp"
 #include "logs/logs.hpp"
 #include "util/net/tlscontext.hpp"
 #include "util/misc.hpp"
+#include "cfg/get.hpp"
 
 namespace ftp
 {
@@ -23,27 +30,47 @@ Server::Server() :
 void Server::Listen(const std::vector<std::string>& validIPs, int port)
 {
   assert(!validIPs.empty());
+  
+  // each ip gets a group of listeners sharing the port, giving
+  // connection storms several accept queues to land in
+  int listenSockets = cfg::Get().ListenSockets();
+  if (listenSockets <= 0) listenSockets = std::max(1u, boost::thread::hardware_concurrency());
+  
   util::net::Endpoint ep;
   try
   {
-    fds.resize(validIPs.size() + 1);
-    int fdsIndex = 0;
     for (const auto& ip : validIPs)
     {
       ep = util::net::Endpoint(ip, port);
-      std::unique_ptr<util::net::TCPListener> listener(new util::net::TCPListener(ep));
-      int fd = listener->Socket();
       
-      fds[fdsIndex].fd = fd;
-      fds[fdsIndex].events = POLLIN;
-      ++fdsIndex;
+      // SO_REUSEPORT would otherwise let a second server on the same
+      // port join this group and take a share of its connections
+      if (listenSockets > 1) util::net::TCPListener::CheckUnused(ep);
       
-      servers.insert(fd, listener.release());
-      logs::Debug("Listening for clients on %1%", ep);
+      for (int i = 0; i < listenSockets; ++i)
+      {
+        std::unique_ptr<util::net::TCPListener> listener(new util::net::TCPListener());
+        listener->SetReusePort(listenSockets > 1);
+        listener->SetNonBlocking(true);
+        listener->SetDeferAccept(cfg::Get().TCPDeferAccept());
+        listener->Listen(ep);
+        
+        int fd = listener->Socket();
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        fds.push_back(pfd);
+        
+        servers.insert(fd, listener.release());
+      }
+      
+      logs::Debug("Listening for clients on %1% (%2% sockets)", ep, listenSockets);
     }
     
-    fds[fdsIndex].fd = interruptPipe.ReadFd();
-    fds[fdsIndex].events = POLLIN;
+    struct pollfd pfd;
+    pfd.fd = interruptPipe.ReadFd();
+    pfd.events = POLLIN;
+    fds.push_back(pfd);
   }
   catch (const util::net::NetworkError& e)
   {
@@ -115,43 +142,71 @@ void Server::StopClients()
 {
   logs::Debug("Stopping all connected clients..");
 
+  Reactor::Get().Shutdown();
+
   for (auto& client : clients)
     client.Interrupt();
   
+  // parked sessions have no thread to notice the interrupt
+  for (auto& client : clients)
+  {
+    if (client.IsParked()) client.Resume();
+  }
+  
   for (auto& client : clients)
     client.Join();
     
   clients.clear();
 }
 
-void Server::AcceptClient(util::net::TCPListener& server)
+bool Server::AcceptClient(util::net::TCPListener& server)
 {
-  std::unique_ptr<ftp::Client> client(new ftp::Client());
-  if (client->Accept(server)) 
+  // a client is only built once the connection has been admitted, so the
+  // final accept of each drain and refused connections stay cheap
+  util::net::TCPSocket socket;
+  try
+  {
+    socket.Accept(server);
+  }
+  catch (const util::net::TimeoutError&)
+  {
+    // listener's accept queue has been drained
+    return false;
+  }
+  catch (const util::net::NetworkError& e)
   {
-    client->Start();
-    clients.insert(client.release());
+    logs::Error("Error while accepting new client: %1%", e.Message());
+    return false;
   }
+  
+  const util::net::IPAddress& ip = socket.RemoteEndpoint().IP();
+  if (!Admission::Get().Admit(ip.IsMappedv4() ? ip.ToUnmappedv4().ToString() : ip.ToString()))
+    return true;
+
+  std::unique_ptr<ftp::Client> client(new ftp::Client());
+  client->Accept(socket);
+  client->Start();
+  clients.insert(client.release());
+  return true;
 }
 
 void Server::AcceptClients()
 {
-  sigset_t mask;
-  sigfillset(&mask);
-  sigdelset(&mask, SIGUSR1);
-
   for (auto& pfd : fds) pfd.revents = 0;
   
-  int n = poll(fds.data(), fds.size(), 100);
+  // tasks and shutdown both arrive via the interrupt pipe,
+  // so there's no need to wake up until something happens
+  int n = poll(fds.data(), fds.size(), -1);
   if (n < 0)
   {
-    logs::Error("Server select failed: %1%", util::Error::Failure(errno).Message());
-    // ensure we don't poll rapidly on repeated select failures
+    if (errno == EINTR) return;
+    logs::Error("Server poll failed: %1%", util::Error::Failure(errno).Message());
+    // ensure we don't poll rapidly on repeated poll failures
     boost::this_thread::sleep(boost::posix_time::milliseconds(100));
   }
   else
   {
-    // last pullfd is interrupt pipe
+    // last pollfd is interrupt pipe
     if (fds.back().revents & POLLIN)
     {
       interruptPipe.Acknowledge();
@@ -160,8 +215,13 @@ void Server::AcceptClients()
     
     for (auto it = fds.begin(); it != fds.end() - 1; ++it)
     {
-      if (it->revents & POLLIN)
-        AcceptClient(servers.at(it->fd));
+      if (!(it->revents & POLLIN)) continue;
+      
+      // drain the queue, a limited number at a time so one busy 
+      // listener can't hold up the others or the task queue
+      auto& server = servers.at(it->fd);
+      int accepted = 0;
+      while (accepted < maxAcceptBatch && AcceptClient(server)) ++accepted;
     }
   }
 }
@@ -169,12 +229,16 @@ void Server::AcceptClients()
 void Server::Run()
 {
   util::SetProcessTitle("SERVER");
+  Reactor::Get().StartThread();
+  SessionPool::Get().StartThreads(cfg::Get().SessionThreads());
   while (!shutdown)
   {
     AcceptClients();
   }
   
   StopClients();
+  SessionPool::Get().Shutdown();
+  LookupCache::Get().Shutdown();
 }
 
 void Server::Shutdown()
@@ -202,4 +266,9 @@ void Server::CleanupClient(Client& client)
   logs::Debug("Client finished");
 }
 
+void Server::ResumeClient(Client& client)
+{
+  client.Resume();
+}
+
 } // end ftp namespace
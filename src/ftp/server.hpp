@@ -66,16 +66,19 @@ class Server : public util::Thread
   
   std::atomic_bool shutdown;
   
+  static const int maxAcceptBatch = 64;
+  
   Server();
 
   void Listen(const std::vector<std::string>& validIPs, int port);
   void AcceptClients();
-  void AcceptClient(util::net::TCPListener& server);
+  bool AcceptClient(util::net::TCPListener& server);
 
   void Run();
   void HandleTasks();
   void StopClients();
   void CleanupClient(Client& client);
+  void ResumeClient(Client& client);
   void PushTask(const TaskPtr& task);  
   
   static std::unique_ptr<Server> instance;
@@ -98,6 +101,7 @@ public:
   friend class task::UserUpdate;
   friend class task::Task;
   friend class task::ClientFinished;
+  friend class task::ResumeClient;
   
   friend void SignalHandler(int);
 };
@@ -0,0 +1,128 @@
+#include "ftp/sessionpool.hpp"
+#include "logs/logs.hpp"
+#include "cfg/get.hpp"
+#include "util/misc.hpp"
+
+namespace ftp
+{
+
+std::unique_ptr<SessionPool> SessionPool::instance;
+boost::once_flag SessionPool::instanceOnce = BOOST_ONCE_INIT;
+
+SessionPool::SessionPool() :
+  idle(0),
+  shutdown(false)
+{
+}
+
+void SessionPool::CreateInstance()
+{
+  instance.reset(new SessionPool());
+}
+
+SessionPool& SessionPool::Get()
+{
+  boost::call_once(&CreateInstance, instanceOnce);
+  return *instance;
+}
+
+void SessionPool::StartThreads(int count)
+{
+  if (count <= 0) return;
+  logs::Debug("Starting %1% session worker threads..", count);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  for (int i = 0; i < count; ++i)
+  {
+    workers.emplace_back();
+    Worker& worker = workers.back();
+    worker.thread = threads.create_thread(std::bind(&SessionPool::Main, this, std::ref(worker)));
+  }
+}
+
+void SessionPool::Shutdown()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (shutdown) return;
+    shutdown = true;
+  }
+
+  logs::Debug("Stopping session worker threads..");
+  cond.notify_all();
+  threads.join_all();
+}
+
+bool SessionPool::Push(const void* owner, const std::function<void()>& session)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (shutdown || idle == 0) return false;
+    // reserves a waiting worker for this session
+    --idle;
+    queue.push(std::make_pair(owner, session));
+  }
+
+  cond.notify_one();
+  return true;
+}
+
+void SessionPool::Interrupt(const void* owner)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto& worker : workers)
+  {
+    if (worker.owner == owner && worker.thread) worker.thread->interrupt();
+  }
+}
+
+void SessionPool::Main(Worker& worker)
+{
+  util::SetProcessTitle("SESSION");
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true)
+  {
+    ++idle;
+    // sessions already queued are run so they can see they're finished
+    while (queue.empty() && !shutdown) cond.wait(lock);
+    if (queue.empty()) break;
+
+    Session session = std::move(queue.front());
+    queue.pop();
+    worker.owner = session.first;
+    lock.unlock();
+
+    try
+    {
+      // config is per thread, a new session thread would have the latest
+      cfg::UpdateLocal();
+      session.second();
+    }
+    catch (const boost::thread_interrupted&)
+    {
+    }
+    catch (const std::exception& e)
+    {
+      logs::Error("Unhandled error on session worker thread: %1%", e.what());
+    }
+    catch (...)
+    {
+      logs::Error("Unhandled error on session worker thread: Not descended from std::exception");
+    }
+
+    lock.lock();
+    worker.owner = nullptr;
+
+    // an interrupt meant for the session that just left mustn't reach the next
+    try
+    {
+      boost::this_thread::interruption_point();
+    }
+    catch (const boost::thread_interrupted&)
+    {
+    }
+  }
+}
+
+} /* ftp namespace */
@@ -0,0 +1,66 @@
+#ifndef __FTP_SESSIONPOOL_HPP
+#define __FTP_SESSIONPOOL_HPP
+
+#include <list>
+#include <queue>
+#include <mutex>
+#include <memory>
+#include <utility>
+#include <functional>
+#include <condition_variable>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/once.hpp>
+
+namespace ftp
+{
+
+// Fixed set of worker threads that parked sessions are resumed on. A
+// worker is held for as long as the session is busy, including transfers,
+// and is given back when the session parks again or finishes. Sessions
+// are only handed to a worker that's idle, so none ever wait for one.
+
+class SessionPool
+{
+  struct Worker
+  {
+    boost::thread* thread;
+    const void* owner; // session currently running on the worker
+
+    Worker() : thread(nullptr), owner(nullptr) { }
+  };
+
+  typedef std::pair<const void*, std::function<void()>> Session;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::queue<Session> queue;
+  std::list<Worker> workers;
+  boost::thread_group threads;
+  int idle;
+  bool shutdown;
+
+  SessionPool();
+
+  void Main(Worker& worker);
+
+  static std::unique_ptr<SessionPool> instance;
+  static boost::once_flag instanceOnce;
+
+  static void CreateInstance();
+
+public:
+  void StartThreads(int count);
+  void Shutdown();
+
+  bool Push(const void* owner, const std::function<void()>& session);
+  /* False if no worker is idle or the pool is shutting down */
+
+  void Interrupt(const void* owner);
+  /* Interrupts the worker running the owner's session, if any */
+
+  static SessionPool& Get();
+};
+
+} /* ftp namespace */
+
+#endif
@@ -3,12 +3,14 @@
 
 #include <algorithm>
 #include <vector>
+#include <memory>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread/thread.hpp>
 #include "ftp/transferstate.hpp"
 #include "cfg/setting.hpp"
 #include "ftp/error.hpp"
 #include "ftp/counter.hpp"
+#include "ftp/tokenbucket.hpp"
 #include "stats/util.hpp"
 #include "ftp/client.hpp"
 #include "acl/misc.hpp"
@@ -23,12 +25,9 @@ class SpeedControl
 {
 private:
   long long minimumSpeed;
-  long long maximumSpeed;
   const TransferState& state;
-  std::vector<const cfg::SpeedLimit*> globalLimits;
-  SpeedCounter& globalCounter;
+  std::vector<std::shared_ptr<TokenBucket>> buckets;
   boost::posix_time::ptime lastMinimumOk;
-  SpeedInfoOpt lastSpeedInfo;
   
   static const int minimumSpeedKickTime = 5;
   
@@ -52,47 +51,59 @@ protected:
                   std::vector<const cfg::SpeedLimit*>&& globalLimits,
                   SpeedCounter& globalCounter) :
     minimumSpeed(minimumSpeed),
-    maximumSpeed(maximumSpeed),
     state(state),
-    globalLimits(globalLimits),
-    globalCounter(globalCounter),
     lastMinimumOk(boost::posix_time::microsec_clock::local_time())
   {
+    if (maximumSpeed > 0)
+    {
+      buckets.emplace_back(std::make_shared<TokenBucket>(maximumSpeed * 1024LL));
+    }
+    
+    for (const auto* limit : globalLimits)
+    {
+      buckets.emplace_back(globalCounter.Bucket(*limit));
+    }
   }
   
 public:
-  inline void Apply()
+  // blocks until transferring at least part of size bytes won't
+  // exceed any of the limits, returns how much can be transferred
+  inline size_t Allowance(size_t size)
   {
-    if (minimumSpeed == 0 && maximumSpeed == 0 && globalLimits.empty()) return;
-
-    auto speedInfo = ftp::SpeedInfo(state.Duration(), state.Bytes());
+    if (buckets.empty()) return size;
     
-    if (minimumSpeed > 0)
+    while (true)
     {
-      CheckMinimum(speedInfo.Speed() / 1024);
+      boost::posix_time::time_duration sleepTime(boost::posix_time::microseconds(0));
+      double allowance = size;
+      for (auto& bucket : buckets)
+      {
+        double available;
+        auto wait = bucket->Wait(std::min<double>(size, bucket->Capacity()), available);
+        sleepTime = std::max(sleepTime, wait);
+        allowance = std::min(allowance, available);
+      }
+      
+      if (sleepTime.total_microseconds() == 0) 
+        return std::max<size_t>(1, allowance);
+      boost::this_thread::sleep(sleepTime);
     }
-    
-    boost::posix_time::time_duration sleepTime(boost::posix_time::microseconds(0));
-    
-    if (maximumSpeed > 0)
+  }
+  
+  inline void Apply(size_t bytes)
+  {
+    for (auto& bucket : buckets)
     {
-      sleepTime = stats::SpeedLimitSleep(speedInfo.xfertime, speedInfo.bytes, 
-                                         maximumSpeed * 1024);
+      bucket->Take(bytes);
     }
     
-    if (!globalLimits.empty())
+    if (minimumSpeed > 0)
     {
-      sleepTime = std::max(sleepTime, globalCounter.Update(lastSpeedInfo, speedInfo, globalLimits));
+      CheckMinimum(ftp::SpeedInfo(state.Duration(), state.Bytes()).Speed() / 1024);
     }
-    
-    boost::this_thread::sleep(sleepTime);
-    lastSpeedInfo = speedInfo;
   }
   
-  virtual ~SpeedControl()
-  {
-    globalCounter.Clear(lastSpeedInfo, globalLimits);
-  }
+  virtual ~SpeedControl() { }
 };
 
 class UploadSpeedControl : public SpeedControl
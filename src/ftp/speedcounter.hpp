@@ -3,12 +3,14 @@
 
 #include <cassert>
 #include <mutex>
+#include <memory>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <unordered_map>
 #include <functional>
 #include <boost/optional.hpp>
 #include <string>
 #include "acl/types.hpp"
+#include "ftp/tokenbucket.hpp"
 
 namespace cfg
 {
@@ -62,10 +64,13 @@ struct SpeedInfo
 
 typedef boost::optional<SpeedInfo> SpeedInfoOpt;
 
+// Token buckets shared by every transfer matching the same 
+// maximum_speed path, released once the last transfer finishes
+
 class SpeedCounter
 {
   std::mutex mutex;
-  std::unordered_map<std::string, std::pair<int, SpeedInfo>> speeds;
+  std::unordered_map<std::string, std::weak_ptr<TokenBucket>> buckets;
   std::function<long long(const cfg::SpeedLimit&)> getSpeedLimit;
 
   SpeedCounter(const std::function<long long(const cfg::SpeedLimit&)>& getSpeedLimit) :
@@ -81,9 +86,7 @@ public:
 
   typedef std::vector<const cfg::SpeedLimit*>& SpeedLimitList;
   
-  boost::posix_time::time_duration 
-  Update(const SpeedInfoOpt& last, const SpeedInfo& current, const SpeedLimitList& limits);
-  void Clear(const SpeedInfoOpt& last, const SpeedLimitList& limits);
+  std::shared_ptr<TokenBucket> Bucket(const cfg::SpeedLimit& limit);
   
   friend class Counter;
 };
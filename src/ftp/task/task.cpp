@@ -126,5 +126,10 @@ void ClientFinished::Execute(Server& server)
   server.CleanupClient(client);
 }
 
+void ResumeClient::Execute(Server& server)
+{
+  server.ResumeClient(client);
+}
+
 }
 }
@@ -112,6 +112,15 @@ public:
   void Execute(Server& server);
 };
 
+class ResumeClient : public Task
+{
+  Client& client;
+  
+public:
+  ResumeClient(Client& client) : client(client) { }
+  void Execute(Server& server);
+};
+
 // end
 }
 }
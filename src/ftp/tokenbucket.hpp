@@ -0,0 +1,87 @@
+#ifndef __FTP_TOKENBUCKET_HPP
+#define __FTP_TOKENBUCKET_HPP
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace ftp
+{
+
+// Refills continuously at the limit rate and holds at most a tenth of
+// a second's worth of bytes, so traffic is smoothed at sub-second
+// granularity. Transfers may overdraw, the debt is paid back by waiting.
+//
+// Shared by every transfer under the same limit, so it's kept lock free.
+// Rather than a token count the bucket tracks the time at which it will
+// next be full (generic cell rate algorithm), which can be advanced with
+// a single compare and swap.
+
+class TokenBucket
+{
+  typedef std::chrono::steady_clock Clock;
+  
+  std::atomic<long long> rate;      // bytes per second
+  std::atomic<long long> fullAt;    // nanoseconds on Clock
+  
+  static const long long burstNanoseconds = 100000000;
+  static const long long minimumCapacity = 4096;
+  
+  static long long Now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+              Clock::now().time_since_epoch()).count();
+  }
+  
+  long long Tolerance(long long rate) const
+  {
+    long long capacity = rate * burstNanoseconds / 1000000000LL;
+    if (capacity >= minimumCapacity) return burstNanoseconds;
+    return minimumCapacity * 1000000000LL / rate;
+  }
+  
+  static long long Duration(double bytes, long long rate)
+  {
+    return static_cast<long long>(bytes / rate * 1000000000.0);
+  }
+  
+public:
+  explicit TokenBucket(long long rate) :
+    rate(rate), fullAt(Now())
+  {
+  }
+  
+  void SetRate(long long rate) { this->rate = rate; }
+  
+  double Capacity() const
+  {
+    long long rate = this->rate;
+    return Tolerance(rate) / 1000000000.0 * rate;
+  }
+  
+  // returns how long until the requested number of bytes are available
+  boost::posix_time::time_duration Wait(double bytes, double& available) const
+  {
+    long long rate = this->rate;
+    long long now = Now();
+    long long emptyAt = std::max<long long>(fullAt, now) - Tolerance(rate);
+    available = (now - emptyAt) / 1000000000.0 * rate;
+    if (available >= bytes) return boost::posix_time::microseconds(0);
+    return boost::posix_time::microseconds((emptyAt + Duration(bytes, rate) - now) / 1000 + 1);
+  }
+  
+  void Take(size_t bytes)
+  {
+    long long rate = this->rate;
+    long long now = Now();
+    long long current = fullAt;
+    while (!fullAt.compare_exchange_weak(current, 
+              std::max(current, now) + Duration(bytes, rate)));
+  }
+};
+
+} /* ftp namespace */
+
+#endif
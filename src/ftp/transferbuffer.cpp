@@ -0,0 +1,42 @@
+#include <algorithm>
+#include "ftp/transferbuffer.hpp"
+#include "ftp/data.hpp"
+#include "cfg/get.hpp"
+
+namespace ftp
+{
+
+TransferBuffer::TransferBuffer(Data& data) :
+  data(data),
+  maximum(cfg::Get().TransferBufferMaximum()),
+  size(cfg::Get().TransferBufferMinimum()),
+  buffer(size),
+  lastAdapt(boost::posix_time::microsec_clock::local_time())
+{
+}
+
+bool TransferBuffer::Adapt()
+{
+  if (size >= maximum) return false;
+  
+  auto now = boost::posix_time::microsec_clock::local_time();
+  if ((now - lastAdapt).total_milliseconds() < adaptInterval) return false;
+  lastAdapt = now;
+  
+  long long duration = data.State().Duration().total_microseconds();
+  long rtt = data.RoundTripTime();
+  if (duration <= 0 || rtt <= 0) return false;
+  
+  // bytes in flight over one round trip at the speed achieved so far
+  long double bdp = static_cast<long double>(data.State().Bytes()) / duration * rtt;
+  
+  // a transfer limited by the current buffer can only reach a bdp close to 
+  // its size, so keep doubling until there's clear headroom
+  if (bdp * 2 < size) return false;
+  
+  size = std::min(size * 2, maximum);
+  buffer.resize(size);
+  return true;
+}
+
+} /* ftp namespace */
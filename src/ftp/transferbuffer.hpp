@@ -0,0 +1,39 @@
+#ifndef __FTP_TRANSFERBUFFER_HPP
+#define __FTP_TRANSFERBUFFER_HPP
+
+#include <vector>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace ftp
+{
+
+class Data;
+
+// Transfer buffer sized from the connection's bandwidth-delay product.
+// Starts at the configured minimum and doubles towards the maximum while
+// the transfer is keeping the buffer full. Socket buffers are left to the
+// kernel's auto tuning, which can grow well beyond what setsockopt allows.
+
+class TransferBuffer
+{
+  Data& data;
+  size_t maximum;
+  size_t size;
+  std::vector<char> buffer;
+  boost::posix_time::ptime lastAdapt;
+  
+  static const int adaptInterval = 250; // milliseconds
+  
+public:
+  explicit TransferBuffer(Data& data);
+  
+  char* Get() { return buffer.data(); }
+  std::vector<char>& Storage() { return buffer; }
+  size_t Size() const { return size; }
+  
+  bool Adapt();
+};
+
+} /* ftp namespace */
+
+#endif
@@ -1,28 +1,210 @@
+#include <cstring>
+#include <cstdint>
 #include "ftp/util.hpp"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8))
+#define ASCII_AVX2
+#include <immintrin.h>
+#endif
+
 namespace ftp {
 
-void LFtoCRLF(const char* source, size_t len, std::vector<char>& dest)
+namespace
+{
+
+// dest only grows, callers use the returned length rather than its size
+// so a reused buffer isn't zero filled again on every chunk
+char* Reserve(std::vector<char>& dest, size_t len)
 {
-  dest.reserve(len * 2);
-  dest.clear();
-  
-  for (size_t i = 0; i < len; ++i)
+  if (dest.size() < len) dest.resize(len);
+  return dest.data();
+}
+
+// copies a block, putting a CR before each LF at a set bit in mask that
+// doesn't already follow one, the byte before the block is checked for
+// an LF at its start unless it's the start of the source
+char* InsertCRs(const char* source, const char* block, size_t width,
+                uint32_t mask, char* out)
+{
+  size_t from = 0;
+  while (mask)
   {
-    if (source[i] == '\n' && i != 0 && source[i - 1] != '\r') dest.emplace_back('\r');
-    dest.emplace_back(source[i]);
+    size_t pos = __builtin_ctz(mask);
+    mask &= mask - 1;
+
+    std::memcpy(out, block + from, pos - from);
+    out += pos - from;
+    if (block + pos != source && block[pos - 1] != '\r') *out++ = '\r';
+    from = pos;
   }
+
+  std::memcpy(out, block + from, width - from);
+  return out + width - from;
 }
 
-void CRLFtoLF(const char* source, size_t len, std::vector<char>& dest)
+// copies a block, leaving out the bytes at set bits in mask
+char* SkipCRs(const char* block, size_t width, uint32_t mask, char* out)
 {
-  dest.reserve(len);
-  dest.clear();
-  
-  for (size_t i = 0; i < len; ++i)
+  size_t from = 0;
+  while (mask)
   {
-    if (source[i] != '\r') dest.emplace_back(source[i]);
+    size_t pos = __builtin_ctz(mask);
+    mask &= mask - 1;
+
+    std::memcpy(out, block + from, pos - from);
+    out += pos - from;
+    from = pos + 1;
   }
+
+  std::memcpy(out, block + from, width - from);
+  return out + width - from;
+}
+
+char* LFtoCRLFScalar(const char* source, size_t i, size_t len, char* out)
+{
+  for (; i < len; ++i)
+  {
+    if (source[i] == '\n' && i != 0 && source[i - 1] != '\r') *out++ = '\r';
+    *out++ = source[i];
+  }
+  return out;
+}
+
+char* CRLFtoLFScalar(const char* source, size_t i, size_t len, char* out)
+{
+  for (; i < len; ++i)
+  {
+    if (source[i] != '\r') *out++ = source[i];
+  }
+  return out;
+}
+
+#if defined(__SSE2__)
+
+char* LFtoCRLFSSE2(const char* source, size_t len, char* out)
+{
+  const __m128i lf = _mm_set1_epi8('\n');
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16)
+  {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+    uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, lf));
+    if (!mask)
+    {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), block);
+      out += 16;
+    }
+    else
+      out = InsertCRs(source, source + i, 16, mask, out);
+  }
+  return LFtoCRLFScalar(source, i, len, out);
+}
+
+char* CRLFtoLFSSE2(const char* source, size_t len, char* out)
+{
+  const __m128i cr = _mm_set1_epi8('\r');
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16)
+  {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+    uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, cr));
+    if (!mask)
+    {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), block);
+      out += 16;
+    }
+    else
+      out = SkipCRs(source + i, 16, mask, out);
+  }
+  return CRLFtoLFScalar(source, i, len, out);
+}
+
+#endif
+
+#if defined(ASCII_AVX2)
+
+__attribute__((target("avx2")))
+char* LFtoCRLFAVX2(const char* source, size_t len, char* out)
+{
+  const __m256i lf = _mm256_set1_epi8('\n');
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32)
+  {
+    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i));
+    uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, lf));
+    if (!mask)
+    {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), block);
+      out += 32;
+    }
+    else
+      out = InsertCRs(source, source + i, 32, mask, out);
+  }
+  return LFtoCRLFScalar(source, i, len, out);
+}
+
+__attribute__((target("avx2")))
+char* CRLFtoLFAVX2(const char* source, size_t len, char* out)
+{
+  const __m256i cr = _mm256_set1_epi8('\r');
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32)
+  {
+    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i));
+    uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, cr));
+    if (!mask)
+    {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), block);
+      out += 32;
+    }
+    else
+      out = SkipCRs(source + i, 32, mask, out);
+  }
+  return CRLFtoLFScalar(source, i, len, out);
+}
+
+bool HaveAVX2()
+{
+  // may run before libgcc has initialised its cpu model
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+const bool haveAVX2 = HaveAVX2();
+
+#endif
+
+}
+
+size_t LFtoCRLF(const char* source, size_t len, std::vector<char>& dest)
+{
+  char* out = Reserve(dest, len * 2);
+#if defined(ASCII_AVX2)
+  if (haveAVX2) return LFtoCRLFAVX2(source, len, out) - out;
+#endif
+#if defined(__SSE2__)
+  return LFtoCRLFSSE2(source, len, out) - out;
+#else
+  return LFtoCRLFScalar(source, 0, len, out) - out;
+#endif
+}
+
+size_t CRLFtoLF(const char* source, size_t len, std::vector<char>& dest)
+{
+  char* out = Reserve(dest, len);
+#if defined(ASCII_AVX2)
+  if (haveAVX2) return CRLFtoLFAVX2(source, len, out) - out;
+#endif
+#if defined(__SSE2__)
+  return CRLFtoLFSSE2(source, len, out) - out;
+#else
+  return CRLFtoLFScalar(source, 0, len, out) - out;
+#endif
 }
 
 } /* ftp namespace */
@@ -8,20 +8,23 @@
 namespace ftp
 {
 
-void CRLFtoLF(const char* source, size_t len, std::vector<char>& dest);
-void LFtoCRLF(const char* source, size_t len, std::vector<char>& dest);
+// Both return the length written to the start of dest, dest is grown
+// as needed but never shrunk so it can be reused between chunks
 
-inline void ASCIITranscodeRETR(const char* source, size_t len, std::vector<char>& asciiBuf)
+size_t CRLFtoLF(const char* source, size_t len, std::vector<char>& dest);
+size_t LFtoCRLF(const char* source, size_t len, std::vector<char>& dest);
+
+inline size_t ASCIITranscodeRETR(const char* source, size_t len, std::vector<char>& asciiBuf)
 {
-  LFtoCRLF(source, len, asciiBuf);
+  return LFtoCRLF(source, len, asciiBuf);
 }
 
-inline void ASCIITranscodeSTOR(const char* source, size_t len, std::vector<char>& asciiBuf)
+inline size_t ASCIITranscodeSTOR(const char* source, size_t len, std::vector<char>& asciiBuf)
 {
 #if defined(__CYGWIN__) || defined(_WIN32) || defined(__WIN64)
-  LFtoCRLF(source, len, asciiBuf);
+  return LFtoCRLF(source, len, asciiBuf);
 #else
-  CRLFtoLF(source, len, asciiBuf);
+  return CRLFtoLF(source, len, asciiBuf);
 #endif
 }
 
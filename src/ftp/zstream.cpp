@@ -0,0 +1,98 @@
+#include <cstring>
+#include "ftp/zstream.hpp"
+#include "util/error.hpp"
+
+namespace ftp
+{
+
+namespace
+{
+const size_t chunkSize = 65536;
+
+std::string ErrorMessage(const z_stream& stream, int result)
+{
+  return std::string("Compression error: ") +
+         (stream.msg ? stream.msg : zError(result));
+}
+}
+
+Deflater::Deflater(int level)
+{
+  std::memset(&stream, 0, sizeof(stream));
+  int result = deflateInit(&stream, level);
+  if (result != Z_OK) throw util::RuntimeError(ErrorMessage(stream, result));
+}
+
+Deflater::~Deflater()
+{
+  deflateEnd(&stream);
+}
+
+const std::vector<char>& Deflater::Deflate(const char* data, size_t len, int flush)
+{
+  output.clear();
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+  stream.avail_in = len;
+
+  do
+  {
+    size_t used = output.size();
+    output.resize(used + chunkSize);
+    stream.next_out = reinterpret_cast<Bytef*>(output.data() + used);
+    stream.avail_out = chunkSize;
+
+    int result = deflate(&stream, flush);
+    if (result == Z_STREAM_ERROR) throw util::RuntimeError(ErrorMessage(stream, result));
+    output.resize(output.size() - stream.avail_out);
+
+    if (result == Z_STREAM_END) break;
+  }
+  while (stream.avail_out == 0 || flush == Z_FINISH);
+
+  return output;
+}
+
+Inflater::Inflater() :
+  input(chunkSize),
+  finished(false)
+{
+  std::memset(&stream, 0, sizeof(stream));
+  int result = inflateInit(&stream);
+  if (result != Z_OK) throw util::RuntimeError(ErrorMessage(stream, result));
+}
+
+Inflater::~Inflater()
+{
+  inflateEnd(&stream);
+}
+
+void Inflater::Supply(size_t len)
+{
+  stream.next_in = reinterpret_cast<Bytef*>(input.data());
+  stream.avail_in = len;
+}
+
+size_t Inflater::Decompress(char* buffer, size_t size)
+{
+  if (finished) return 0;
+
+  stream.next_out = reinterpret_cast<Bytef*>(buffer);
+  stream.avail_out = size;
+
+  int result = inflate(&stream, Z_NO_FLUSH);
+  switch (result)
+  {
+    case Z_STREAM_END :
+      finished = true;
+      break;
+    case Z_OK         :
+    case Z_BUF_ERROR  :
+      break;
+    default           :
+      throw util::RuntimeError(ErrorMessage(stream, result));
+  }
+
+  return size - stream.avail_out;
+}
+
+} /* ftp namespace */
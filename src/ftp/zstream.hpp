@@ -0,0 +1,59 @@
+#ifndef __FTP_ZSTREAM_HPP
+#define __FTP_ZSTREAM_HPP
+
+#include <vector>
+#include <zlib.h>
+
+namespace ftp
+{
+
+// Streaming deflate stages for MODE Z, the data connection carries a
+// single zlib stream per transfer which is finished when it's closed.
+
+class Deflater
+{
+  z_stream stream;
+  std::vector<char> output;
+
+  const std::vector<char>& Deflate(const char* data, size_t len, int flush);
+
+public:
+  explicit Deflater(int level);
+  ~Deflater();
+
+  Deflater(const Deflater&) = delete;
+  Deflater& operator=(const Deflater&) = delete;
+
+  // returned output is only valid until the next call
+  const std::vector<char>& Compress(const char* data, size_t len)
+  { return Deflate(data, len, Z_NO_FLUSH); }
+  const std::vector<char>& Finish()
+  { return Deflate(nullptr, 0, Z_FINISH); }
+};
+
+class Inflater
+{
+  z_stream stream;
+  std::vector<char> input;
+  bool finished;
+
+public:
+  Inflater();
+  ~Inflater();
+
+  Inflater(const Inflater&) = delete;
+  Inflater& operator=(const Inflater&) = delete;
+
+  bool NeedsInput() const { return stream.avail_in == 0; }
+  bool Finished() const { return finished; }
+
+  char* Input() { return input.data(); }
+  size_t InputSize() const { return input.size(); }
+  void Supply(size_t len);
+
+  size_t Decompress(char* buffer, size_t size);
+};
+
+} /* ftp namespace */
+
+#endif
@@ -0,0 +1,173 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/parsers.hpp>
+#include "ftp/util.hpp"
+#include "version.hpp"
+
+namespace po = boost::program_options;
+
+typedef std::function<size_t(const char*, size_t, std::vector<char>&)> Transcoder;
+
+// byte at a time conversions the vectorised ones replaced, kept here
+// to compare against
+
+size_t ReferenceLFtoCRLF(const char* source, size_t len, std::vector<char>& dest)
+{
+  dest.reserve(len * 2);
+  dest.clear();
+  
+  for (size_t i = 0; i < len; ++i)
+  {
+    if (source[i] == '\n' && i != 0 && source[i - 1] != '\r') dest.emplace_back('\r');
+    dest.emplace_back(source[i]);
+  }
+  return dest.size();
+}
+
+size_t ReferenceCRLFtoLF(const char* source, size_t len, std::vector<char>& dest)
+{
+  dest.reserve(len);
+  dest.clear();
+  
+  for (size_t i = 0; i < len; ++i)
+  {
+    if (source[i] != '\r') dest.emplace_back(source[i]);
+  }
+  return dest.size();
+}
+
+void DisplayHelp(char* argv0, po::options_description& desc)
+{
+  std::cout << "usage: " << argv0 << " [options]" << std::endl;
+  std::cout << desc;
+}
+
+void DisplayVersion()
+{
+  std::cout << "ebftpd asciibench " + std::string(version) << std::endl;
+}
+
+bool ParseOptions(int argc, char** argv, size_t& chunkSize, size_t& totalMBytes, 
+                  size_t& lineLength)
+{
+  po::options_description visible("supported options");
+  visible.add_options()
+    ("help,h", "display this help message")
+    ("version,v", "display version")
+    ("chunk-size,s", po::value<size_t>(&chunkSize)->default_value(16384), "bytes per chunk, as read by transfers")
+    ("total,t", po::value<size_t>(&totalMBytes)->default_value(1024), "megabytes to convert per implementation")
+    ("line-length,l", po::value<size_t>(&lineLength)->default_value(80), "average line length of the generated text")
+  ;
+  
+  po::variables_map vm;
+  try
+  {
+    po::store(po::command_line_parser(argc, argv).options(visible).run(), vm);
+
+    if (vm.count("help"))
+    {
+      DisplayHelp(argv[0], visible);
+      return false;
+    }
+
+    if (vm.count("version"))
+    {
+      DisplayVersion();
+      return false;
+    }
+
+    po::notify(vm);
+  }
+  catch (const po::error& e)
+  {
+    std::cerr << e.what() << std::endl;
+    DisplayHelp(argv[0], visible);
+    return false;
+  }
+  
+  if (chunkSize == 0 || totalMBytes == 0 || lineLength == 0)
+  {
+    std::cerr << "chunk size, total and line length must be greater than zero" << std::endl;
+    return false;
+  }
+  
+  return true;
+}
+
+// text with lines of random length around the average, with or without CRs
+std::vector<char> MakeText(size_t size, size_t lineLength, bool crlf)
+{
+  std::vector<char> text;
+  text.reserve(size);
+  while (text.size() < size)
+  {
+    size_t length = 1 + rand() % (lineLength * 2);
+    for (size_t i = 0; i < length && text.size() < size; ++i)
+      text.push_back(' ' + rand() % 95);
+    if (crlf && text.size() < size) text.push_back('\r');
+    if (text.size() < size) text.push_back('\n');
+  }
+  return text;
+}
+
+std::vector<char> Run(const std::string& name, const Transcoder& transcode,
+                      const std::vector<char>& source, size_t totalBytes)
+{
+  std::vector<char> dest;
+  size_t len = 0;
+  size_t done = 0;
+  
+  auto start = std::chrono::steady_clock::now();
+  while (done < totalBytes)
+  {
+    len = transcode(source.data(), source.size(), dest);
+    done += source.size();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  
+  std::cout << std::left << std::setw(20) << name 
+            << std::fixed << std::setprecision(2) 
+            << done / elapsed.count() / (1024.0 * 1024.0) << " MB/s" << std::endl;
+  
+  dest.resize(len);
+  return dest;
+}
+
+bool Compare(const std::string& name, const Transcoder& reference, const Transcoder& current,
+             const std::vector<char>& source, size_t totalBytes)
+{
+  auto expected = Run(name + " (old)", reference, source, totalBytes);
+  if (Run(name, current, source, totalBytes) != expected)
+  {
+    std::cerr << name << " output differs" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  size_t chunkSize;
+  size_t totalMBytes;
+  size_t lineLength;
+  
+  if (!ParseOptions(argc, argv, chunkSize, totalMBytes, lineLength)) return 1;
+
+  srand(1);
+  size_t totalBytes = totalMBytes * 1024 * 1024;
+  std::cout << totalMBytes << "MB in " << chunkSize << " byte chunks, "
+            << lineLength << " byte lines" << std::endl;
+  
+  bool okay = Compare("LFtoCRLF", &ReferenceLFtoCRLF, &ftp::LFtoCRLF, 
+                      MakeText(chunkSize, lineLength, false), totalBytes);
+  okay = Compare("CRLFtoLF", &ReferenceCRLFtoLF, &ftp::CRLFtoLF,
+                 MakeText(chunkSize, lineLength, true), totalBytes) && okay;
+  
+  return okay ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/parsers.hpp>
+#include "util/sliceby8.hpp"
+#include "util/pclmul.hpp"
+#include "version.hpp"
+
+namespace po = boost::program_options;
+
+typedef uint32_t (*CRCFunction)(const uint8_t*, size_t, uint32_t);
+
+void DisplayHelp(char* argv0, po::options_description& desc)
+{
+  std::cout << "usage: " << argv0 << " [options]" << std::endl;
+  std::cout << desc;
+}
+
+void DisplayVersion()
+{
+  std::cout << "ebftpd crcbench " + std::string(version) << std::endl;
+}
+
+bool ParseOptions(int argc, char** argv, size_t& chunkSize, size_t& totalMBytes)
+{
+  po::options_description visible("supported options");
+  visible.add_options()
+    ("help,h", "display this help message")
+    ("version,v", "display version")
+    ("chunk-size,s", po::value<size_t>(&chunkSize)->default_value(16384), "bytes per update, as fed by uploads")
+    ("total,t", po::value<size_t>(&totalMBytes)->default_value(4096), "megabytes to checksum per implementation")
+  ;
+  
+  po::variables_map vm;
+  try
+  {
+    po::store(po::command_line_parser(argc, argv).options(visible).run(), vm);
+
+    if (vm.count("help"))
+    {
+      DisplayHelp(argv[0], visible);
+      return false;
+    }
+
+    if (vm.count("version"))
+    {
+      DisplayVersion();
+      return false;
+    }
+
+    po::notify(vm);
+  }
+  catch (const po::error& e)
+  {
+    std::cerr << e.what() << std::endl;
+    DisplayHelp(argv[0], visible);
+    return false;
+  }
+  
+  if (chunkSize == 0 || totalMBytes == 0)
+  {
+    std::cerr << "chunk size and total must be greater than zero" << std::endl;
+    return false;
+  }
+  
+  return true;
+}
+
+uint32_t Run(const std::string& name, CRCFunction function, 
+             const std::vector<uint8_t>& buffer, size_t totalBytes)
+{
+  uint32_t crc = 0;
+  size_t done = 0;
+  
+  auto start = std::chrono::steady_clock::now();
+  while (done < totalBytes)
+  {
+    crc = function(buffer.data(), buffer.size(), crc);
+    done += buffer.size();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  
+  std::cout << std::left << std::setw(10) << name 
+            << std::fixed << std::setprecision(2) 
+            << done / elapsed.count() / (1024.0 * 1024.0 * 1024.0) << " GB/s"
+            << "  crc " << std::hex << std::uppercase << crc << std::dec << std::endl;
+  return crc;
+}
+
+int main(int argc, char** argv)
+{
+  size_t chunkSize;
+  size_t totalMBytes;
+  
+  if (!ParseOptions(argc, argv, chunkSize, totalMBytes)) return 1;
+  
+  std::vector<uint8_t> buffer(chunkSize);
+  srand(1);
+  for (auto& byte : buffer) byte = rand();
+  
+  size_t totalBytes = totalMBytes * 1024 * 1024;
+  std::cout << totalMBytes << "MB in " << chunkSize << " byte updates" << std::endl;
+  
+  uint32_t expected = Run("sliceby8", &util::sliceby8::crc32, buffer, totalBytes);
+  
+  if (!util::pclmul::Supported())
+  {
+    std::cout << "pclmul    not supported by this cpu" << std::endl;
+    return 0;
+  }
+  
+  if (Run("pclmul", &util::pclmul::crc32, buffer, totalBytes) != expected)
+  {
+    std::cerr << "checksums differ" << std::endl;
+    return 1;
+  }
+  
+  return 0;
+}
@@ -0,0 +1,191 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/lexical_cast.hpp>
+#include "util/net/tcpsocket.hpp"
+#include "util/net/endpoint.hpp"
+#include "util/net/error.hpp"
+#include "version.hpp"
+
+namespace po = boost::program_options;
+
+// Downloads the same small file over and over from a running server, each
+// over a new EPSV data connection, and reports files per second. Run it
+// against the server with pasv_pool set to 0 and then to a few listeners
+// to compare per file data connection setup with and without the pool.
+
+struct Options
+{
+  std::string host;
+  int port;
+  std::string user;
+  std::string password;
+  std::string path;
+  int count;
+};
+
+void DisplayHelp(char* argv0, po::options_description& desc)
+{
+  std::cout << "usage: " << argv0 << " [options] <user> <password> <path>" << std::endl;
+  std::cout << desc;
+}
+
+void DisplayVersion()
+{
+  std::cout << "ebftpd pasvbench " + std::string(version) << std::endl;
+}
+
+bool ParseOptions(int argc, char** argv, Options& options)
+{
+  po::options_description visible("supported options");
+  visible.add_options()
+    ("help,h", "display this help message")
+    ("version,v", "display version")
+    ("host,H", po::value<std::string>(&options.host)->default_value("127.0.0.1"), "server address")
+    ("port,p", po::value<int>(&options.port)->default_value(21), "server port")
+    ("count,n", po::value<int>(&options.count)->default_value(1000), "number of downloads")
+  ;
+  
+  po::options_description all("positional options");
+  all.add(visible);
+  all.add_options()
+    ("user", po::value<std::string>(&options.user)->required(), "username")
+    ("password", po::value<std::string>(&options.password)->required(), "password")
+    ("path", po::value<std::string>(&options.path)->required(), "small file to download")
+  ;
+
+  po::positional_options_description pos;
+  pos.add("user", 1);
+  pos.add("password", 1);
+  pos.add("path", 1);
+
+  po::variables_map vm;
+  try
+  {
+    po::store(po::command_line_parser(argc, argv).options(all).positional(pos).run(), vm);
+
+    if (vm.count("help"))
+    {
+      DisplayHelp(argv[0], visible);
+      return false;
+    }
+
+    if (vm.count("version"))
+    {
+      DisplayVersion();
+      return false;
+    }
+
+    po::notify(vm);
+  }
+  catch (const po::error& e)
+  {
+    std::cerr << e.what() << std::endl;
+    DisplayHelp(argv[0], visible);
+    return false;
+  }
+  
+  return true;
+}
+
+class Control
+{
+  util::net::TCPSocket socket;
+  
+public:
+  Control(const util::net::Endpoint& ep) : socket(ep) { }
+  
+  // returns the final line of a possibly multi line reply
+  std::string Reply(int expected)
+  {
+    std::string line;
+    do
+    {
+      socket.Getline(line, true);
+    }
+    while (line.length() < 4 || line[3] != ' ' || !isdigit(line[0]));
+    
+    if (boost::lexical_cast<int>(line.substr(0, 3)) != expected)
+      throw std::runtime_error("Unexpected reply: " + line);
+    return line;
+  }
+  
+  std::string Command(const std::string& command, int expected)
+  {
+    std::string line = command + "\r\n";
+    socket.Write(line.data(), line.length());
+    return Reply(expected);
+  }
+};
+
+int PassivePort(const std::string& reply)
+{
+  std::string::size_type start = reply.find("|||");
+  std::string::size_type end = reply.find('|', start + 3);
+  if (start == std::string::npos || end == std::string::npos)
+    throw std::runtime_error("Malformed EPSV reply: " + reply);
+  return boost::lexical_cast<int>(reply.substr(start + 3, end - start - 3));
+}
+
+long long Download(Control& control, const Options& options)
+{
+  int port = PassivePort(control.Command("EPSV", 229));
+  util::net::TCPSocket data(util::net::Endpoint(options.host, port));
+  control.Command("RETR " + options.path, 150);
+  
+  char buffer[16384];
+  long long bytes = 0;
+  try
+  {
+    while (true) bytes += data.Read(buffer, sizeof(buffer));
+  }
+  catch (const util::net::EndOfStream&) { }
+  
+  control.Reply(226);
+  return bytes;
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, options)) return 1;
+  
+  try
+  {
+    Control control(util::net::Endpoint(options.host, options.port));
+    control.Reply(220);
+    control.Command("USER " + options.user, 331);
+    control.Command("PASS " + options.password, 230);
+    control.Command("TYPE I", 200);
+    
+    long long bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.count; ++i)
+    {
+      bytes += Download(control, options);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    
+    control.Command("QUIT", 221);
+    
+    std::cout << options.count << " files, " << bytes << " bytes in " 
+              << std::fixed << std::setprecision(2) << elapsed.count() << "s, "
+              << options.count / elapsed.count() << " files/s" << std::endl;
+  }
+  catch (const util::net::NetworkError& e)
+  {
+    std::cerr << "Network error: " << e.Message() << std::endl;
+    return 1;
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  
+  return 0;
+}
@@ -1,138 +1,197 @@
 #ifndef __UTIL_ASYNCCRC32_HPP
 #define __UTIL_ASYNCCRC32_HPP
 
-#include <memory>
+#include <ios>
+#include <atomic>
 #include <algorithm>
 #include <cassert>
 #include <string>
+#include <vector>
 #include <cstdint>
-#include <array>
 #include <boost/thread/thread.hpp>
 #include <mutex>
 #include <condition_variable>
 #include "util/crc32.hpp"
+#include "util/asyncwriter.hpp"
 
 namespace util
 {
 
+// Checksums buffers on a separate thread. Buffers are handed over rather
+// than copied, Update swaps the caller's buffer for an already checksummed
+// one from a single producer / single consumer ring. The ring positions
+// are atomics, the mutex is only taken when one side has to sleep, and
+// each side only wakes the other if it's actually sleeping, so a busy
+// transfer doesn't signal per buffer.
+//
+// When a writer is given, checksummed buffers are passed on to it rather
+// than recycled, a failed write is reported by the next call to Update or
+// Flush. Only the thread that constructed the object may call Update,
+// Flush or Checksum.
+
 class AsyncCRC32 : public CRC32
 {
-  typedef std::vector<uint8_t> DataVec;
+  typedef std::vector<char> DataVec;
 
-  struct Buffer
+  struct Slot
   {
-    size_t len;
-    bool empty;
     DataVec data;
-    
-    Buffer(size_t bufferSize) : 
-      len(0), empty(true)
-    {
-      data.resize(bufferSize);
-    }
+    size_t len;
+
+    Slot() : len(0) { }
   };
 
-  typedef std::vector<Buffer*> QueueVec;
-  
-  bool finished;
-  unsigned pending;
+  std::vector<Slot> ring;
+  std::atomic<size_t> head;   // slots filled by the producer
+  std::atomic<size_t> tail;   // slots checksummed by the consumer
+  std::atomic<bool> finished;
+  std::atomic<bool> consumerSleeping;
+  mutable std::atomic<bool> producerSleeping;
+  std::atomic<bool> failed;
+  std::string error;
   mutable std::mutex mutex;
-  mutable std::condition_variable readCond;
-  mutable std::condition_variable writeCond;
-  QueueVec queue;
-  typename QueueVec::iterator readIt;
-  typename QueueVec::iterator writeIt;
+  mutable std::condition_variable cond;
+  AsyncWriter* writer;
   boost::thread thread;
-  
+
+  void Wake(const std::atomic<bool>& sleeping)
+  {
+    if (sleeping)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      cond.notify_all();
+    }
+  }
+
   void Main()
   {
+    size_t pos = tail.load(std::memory_order_relaxed);
     while (true)
     {
+      if (pos == head)
       {
         std::unique_lock<std::mutex> lock(mutex);
-        if ((*readIt)->empty)
+        consumerSleeping = true;
+        while (pos == head && !finished) cond.wait(lock);
+        consumerSleeping = false;
+      }
+
+      // anything still queued when destroyed is abandoned
+      if (finished) break;
+
+      Slot& slot = ring[pos % ring.size()];
+      CRC32::Update(reinterpret_cast<const uint8_t*>(slot.data.data()), slot.len);
+
+      if (writer && !failed)
+      {
+        try
+        {
+          writer->Write(slot.data, slot.len);
+        }
+        catch (const std::ios_base::failure& e)
         {
-          if (finished) break;
-          readCond.wait(lock);
-          if (finished) break;
+          error = e.what();
+          failed = true;
         }
       }
-      
-      CRC32::Update((*readIt)->data.data(), (*readIt)->len);
-
-      mutex.lock();
-      (*readIt)->empty = true;
-      --pending;
-      mutex.unlock();
 
-      writeCond.notify_one();
-      if (++readIt == queue.end()) readIt = queue.begin();
+      tail = ++pos;
+      Wake(producerSleeping);
     }
   }
-  
-   void WaitPending() const
+
+  // waits for the consumer to get within maxPending slots of the producer
+  void WaitPending(size_t maxPending) const
   {
+    size_t pos = head.load(std::memory_order_relaxed);
+    if (pos - tail <= maxPending) return;
+
     std::unique_lock<std::mutex> lock(mutex);
-    while (pending > 0) writeCond.wait(lock);
+    producerSleeping = true;
+    while (pos - tail > maxPending) cond.wait(lock);
+    producerSleeping = false;
   }
-  
+
+  void CheckError()
+  {
+    if (failed) throw std::ios_base::failure(error);
+  }
+
+  Slot& NextSlot()
+  {
+    WaitPending(ring.size() - 1);
+    CheckError();
+    return ring[head.load(std::memory_order_relaxed) % ring.size()];
+  }
+
+  void Publish()
+  {
+    ++head;
+    Wake(consumerSleeping);
+  }
+
 public:
-  AsyncCRC32(size_t bufferSize, unsigned queueSize) : 
+  AsyncCRC32(unsigned queueSize, AsyncWriter* writer = nullptr) :
+    ring(queueSize),
+    head(0),
+    tail(0),
     finished(false),
-    pending(0)
+    consumerSleeping(false),
+    producerSleeping(false),
+    failed(false),
+    writer(writer)
   {
-    while (queue.size() < queueSize)
-    { 
-      queue.emplace_back(new Buffer(bufferSize));
-    }
-    
-    readIt = queue.begin();
-    writeIt = queue.begin();
+    assert(queueSize > 0);
     thread = boost::thread(&AsyncCRC32::Main, this);
   }
-  
+
   ~AsyncCRC32()
   {
-    mutex.lock();
-    finished = true;
-    mutex.unlock();
-    
-    readCond.notify_one();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      finished = true;
+    }
+
+    cond.notify_all();
     thread.join();
-    for (auto buf : queue) delete buf;
   }
-  
+
+  // copies, only for callers that can't give up their buffer
   void Update(const uint8_t* bytes, unsigned len)
   {
-    assert(len <= (*writeIt)->data.size());
-    
-    {
-      std::unique_lock<std::mutex> lock(mutex);
-      while (!(*writeIt)->empty) writeCond.wait(lock);
-    }
-
-    std::copy(&bytes[0], &bytes[len], (*writeIt)->data.begin());
+    Slot& slot = NextSlot();
+    if (slot.data.size() < len) slot.data.resize(len);
+    std::copy(bytes, bytes + len, slot.data.begin());
+    slot.len = len;
+    Publish();
+  }
 
-    (*writeIt)->len = len;
+  // buffer is exchanged for a recycled one of the same size
+  void Update(DataVec& buffer, size_t len)
+  {
+    Slot& slot = NextSlot();
+    size_t size = buffer.size();
+    slot.data.swap(buffer);
+    slot.len = len;
+    Publish();
+    buffer.resize(size);
+  }
 
-    mutex.lock();
-    (*writeIt)->empty = false;    
-    ++pending;
-    mutex.unlock();
-    
-    readCond.notify_one();
-    if (++writeIt == queue.end()) writeIt = queue.begin();
+  void Flush()
+  {
+    WaitPending(0);
+    CheckError();
   }
-  
+
   uint32_t Checksum() const
   {
-    WaitPending();
+    WaitPending(0);
     return CRC32::Checksum();
   }
-  
+
   std::string HexString() const
   {
-    WaitPending();
+    WaitPending(0);
     return CRC32::HexString();
   }
 };
@@ -0,0 +1,160 @@
+#ifndef __UTIL_ASYNCWRITER_HPP
+#define __UTIL_ASYNCWRITER_HPP
+
+#include <ios>
+#include <deque>
+#include <vector>
+#include <string>
+#include <cerrno>
+#include <unistd.h>
+#include <boost/thread/thread.hpp>
+#include <mutex>
+#include <condition_variable>
+#include "util/error.hpp"
+
+namespace util
+{
+
+// Writes buffers to a file descriptor from a separate thread so the caller
+// can carry on filling the next buffer. At most queueSize buffers are in
+// flight, after which Write blocks. Buffers are recycled rather than copied.
+// A failed write is reported by the next call to Write or Flush.
+
+class AsyncWriter
+{
+  typedef std::vector<char> DataVec;
+
+  struct Pending
+  {
+    DataVec data;
+    size_t len;
+  };
+
+  int fd;
+  unsigned queueSize;
+  bool finished;
+  bool writing;
+  std::string error;
+  std::deque<Pending> queue;
+  std::vector<DataVec> spare;
+  std::mutex mutex;
+  std::condition_variable readCond;
+  std::condition_variable writeCond;
+  boost::thread thread;
+  
+  void WriteAll(const char* data, size_t len)
+  {
+    while (len > 0)
+    {
+      ssize_t result = ::write(fd, data, len);
+      if (result < 0)
+      {
+        if (errno == EINTR) continue;
+        throw util::SystemError(errno);
+      }
+      data += result;
+      len -= result;
+    }
+  }
+  
+  void Main()
+  {
+    while (true)
+    {
+      Pending pending;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (queue.empty() && !finished) readCond.wait(lock);
+        if (queue.empty()) break;
+        pending = std::move(queue.front());
+        queue.pop_front();
+        writing = true;
+      }
+      
+      std::string result;
+      try
+      {
+        WriteAll(pending.data.data(), pending.len);
+      }
+      catch (const util::SystemError& e)
+      {
+        result = e.Message();
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        writing = false;
+        spare.emplace_back(std::move(pending.data));
+        if (!result.empty() && error.empty())
+        {
+          // nothing further can be written reliably
+          error = result;
+          queue.clear();
+        }
+      }
+      
+      writeCond.notify_one();
+    }
+  }
+  
+  void CheckError()
+  {
+    if (!error.empty()) throw std::ios_base::failure(error);
+  }
+  
+public:
+  AsyncWriter(int fd, unsigned queueSize) :
+    fd(fd),
+    queueSize(queueSize),
+    finished(false),
+    writing(false)
+  {
+    thread = boost::thread(&AsyncWriter::Main, this);
+  }
+  
+  ~AsyncWriter()
+  {
+    mutex.lock();
+    finished = true;
+    mutex.unlock();
+    
+    readCond.notify_one();
+    thread.join();
+  }
+  
+  // buffer is exchanged for a recycled one of the same size
+  void Write(DataVec& buffer, size_t len)
+  {
+    Pending pending;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (error.empty() && queue.size() + writing >= queueSize) 
+        writeCond.wait(lock);
+      CheckError();
+
+      size_t size = buffer.size();
+      pending.data.swap(buffer);
+      pending.len = len;
+      if (!spare.empty())
+      {
+        buffer.swap(spare.back());
+        spare.pop_back();
+      }
+      buffer.resize(size);
+      queue.emplace_back(std::move(pending));
+    }
+    
+    readCond.notify_one();
+  }
+  
+  void Flush()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (error.empty() && (!queue.empty() || writing)) writeCond.wait(lock);
+    CheckError();
+  }
+};
+
+} /* util namespace */
+
+#endif
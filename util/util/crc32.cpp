@@ -0,0 +1,11 @@
+#include "util/crc32.hpp"
+#include "util/sliceby8.hpp"
+#include "util/pclmul.hpp"
+
+namespace util
+{
+
+const CRC32::UpdateFunction CRC32::update = 
+  pclmul::Supported() ? &pclmul::crc32 : &sliceby8::crc32;
+
+} /* util namespace */
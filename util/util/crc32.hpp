@@ -5,22 +5,27 @@
 #include <iomanip>
 #include <string>
 #include <cstdint>
-#include "util/sliceby8.hpp"
+#include <sys/types.h>
 
 namespace util
 {
 
 class CRC32
 {
+  typedef uint32_t (*UpdateFunction)(const uint8_t*, size_t, uint32_t);
+
   uint32_t checksum;
   
+  static const UpdateFunction update;
+  /* pclmul when the cpu supports it, otherwise slice by 8 */
+  
 public:
   CRC32() : checksum(0) { }
   virtual ~CRC32() { }
   
   virtual void Update(const uint8_t* bytes, unsigned len)
   {
-    checksum = sliceby8::crc32(bytes, len, checksum);
+    checksum = update(bytes, len, checksum);
   }
   
   virtual uint32_t Checksum() const { return checksum; }
@@ -1,6 +1,8 @@
 #include <algorithm>
 #include <cerrno>
 #include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <boost/thread/thread.hpp>
 #include "util/net/tcplistener.hpp"
 #include "util/net/error.hpp"
@@ -18,27 +20,49 @@ TCPListener::~TCPListener()
 TCPListener::TCPListener(const util::net::Endpoint& endpoint, int backlog) :
   endpoint(endpoint),
   socket(-1),
-  backlog(backlog)
+  backlog(backlog),
+  reusePort(false),
+  nonBlocking(false),
+  deferAccept(0)
 {
   Listen();
 }
 
 TCPListener::TCPListener(int backlog) :
   socket(-1),
-  backlog(backlog)
+  backlog(backlog),
+  reusePort(false),
+  nonBlocking(false),
+  deferAccept(0)
 {
 }
 
 void TCPListener::Listen()
 {
   assert(socket == -1);
-  int socket = ::socket(static_cast<int>(endpoint.Family()), SOCK_STREAM, 0);
+  int socket = ::socket(static_cast<int>(endpoint.Family()), 
+                        SOCK_STREAM | SOCK_CLOEXEC | (nonBlocking ? SOCK_NONBLOCK : 0), 0);
   if (socket < 0) return throw NetworkSystemError(errno);
 
   auto socketGuard = util::MakeScopeError([&socket]() {  close(socket);  }); (void) socketGuard;
 
   int optVal = 1;
   setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &optVal, sizeof(optVal));
+  
+  // several listeners on the same endpoint get their own accept queues
+  // with the kernel spreading new connections between them
+  if (reusePort && setsockopt(socket, SOL_SOCKET, SO_REUSEPORT, &optVal, sizeof(optVal)) < 0)
+  {
+    int errno_ = errno;
+    throw util::net::NetworkSystemError(errno_);
+  }
+  
+  if (deferAccept > 0 && 
+      setsockopt(socket, IPPROTO_TCP, TCP_DEFER_ACCEPT, &deferAccept, sizeof(deferAccept)) < 0)
+  {
+    int errno_ = errno;
+    throw util::net::NetworkSystemError(errno_);
+  }
 
   socklen_t addrLen = endpoint.Length();
   struct sockaddr_storage addrStor;
@@ -69,6 +93,25 @@ void TCPListener::Listen()
   this->socket = socket;
 }
 
+void TCPListener::CheckUnused(const util::net::Endpoint& endpoint)
+{
+  int socket = ::socket(static_cast<int>(endpoint.Family()), SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (socket < 0) throw NetworkSystemError(errno);
+  
+  auto socketGuard = util::MakeScopeExit([&socket]() {  close(socket);  }); (void) socketGuard;
+  
+  // without SO_REUSEPORT the bind conflicts with any listening socket,
+  // SO_REUSEADDR stops connections left in TIME_WAIT getting in the way
+  int optVal = 1;
+  setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &optVal, sizeof(optVal));
+  
+  if (bind(socket, endpoint.Addr(), endpoint.Length()) < 0)
+  {
+    int errno_ = errno;
+    throw util::net::NetworkSystemError(errno_);
+  }
+}
+
 void TCPListener::Listen(const util::net::Endpoint& endpoint)
 {
   this->endpoint = endpoint;
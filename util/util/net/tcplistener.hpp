@@ -18,6 +18,9 @@ class TCPListener : boost::noncopyable
   std::mutex socketMutex;
   int socket;
   int backlog;
+  bool reusePort;
+  bool nonBlocking;
+  int deferAccept;
 
   TCPListener(const TCPListener&) = delete;
   TCPListener& operator=(const TCPListener&) = delete;
@@ -41,6 +44,19 @@ public:
   void Accept(TCPSocket& socket);
   /* Throws NetworkSystemError, InvalidIPAddressError */
   
+  void SetReusePort(bool reusePort) { this->reusePort = reusePort; }
+  /* No exceptions, must be set before listening */
+  
+  static void CheckUnused(const Endpoint& endpoint);
+  /* Throws NetworkSystemError, EADDRINUSE if anything is listening on 
+     endpoint, including SO_REUSEPORT groups a new listener would join */
+  
+  void SetNonBlocking(bool nonBlocking) { this->nonBlocking = nonBlocking; }
+  /* No exceptions, must be set before listening */
+  
+  void SetDeferAccept(int seconds) { deferAccept = seconds; }
+  /* No exceptions, must be set before listening */
+  
   void Close();
   /* No exceptions */
   
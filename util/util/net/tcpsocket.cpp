@@ -1,4 +1,8 @@
 #include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <boost/thread/thread.hpp>
 #include "util/net/tcpsocket.hpp"
 #include "util/net/tcplistener.hpp"
@@ -133,7 +137,7 @@ void TCPSocket::Accept(TCPListener& listener)
   struct sockaddr* addr = reinterpret_cast<struct sockaddr*>(&addrStor);
 
   int socket;
-  while ((socket = accept(listener.Socket(), addr, &addrLen)) < 0)
+  while ((socket = accept4(listener.Socket(), addr, &addrLen, SOCK_CLOEXEC)) < 0)
   {
     boost::this_thread::interruption_point();
     if (errno != EINTR)
@@ -155,11 +159,30 @@ void TCPSocket::Accept(TCPListener& listener)
   this->socket = socket;
 }
 
-void TCPSocket::HandshakeTLS(TLSSocket::HandshakeRole role)
+void TCPSocket::Accept(TCPSocket& pending)
+{
+  assert(!pending.tls.get());
+  
+  int socket;
+  {
+    std::lock_guard<std::mutex> lock(pending.socketMutex);
+    socket = pending.socket;
+    pending.socket = -1;
+  }
+  
+  localEndpoint = pending.localEndpoint;
+  remoteEndpoint = pending.remoteEndpoint;
+  
+  std::lock_guard<std::mutex> lock(socketMutex);
+  this->socket = socket;
+}
+
+void TCPSocket::HandshakeTLS(TLSSocket::HandshakeRole role, const TCPSocket* id,
+                             bool kernelOffload)
 {
   try
   {
-    tls.reset(new TLSSocket(*this, role));
+    tls.reset(new TLSSocket(*this, role, id ? id->tls.get() : nullptr, kernelOffload));
   }
   catch (const NetworkError&)
   {
@@ -219,6 +242,121 @@ void TCPSocket::Write(const char* buffer, size_t bufferLen)
   }
 }
 
+size_t TCPSocket::ReadNonBlocking(char* buffer, size_t bufferSize)
+{
+  if (tls.get())
+  {
+    if (!tls->HasBufferedInput()) return 0;
+    return tls->Read(buffer, bufferSize);
+  }
+  
+  ssize_t result;
+  while ((result = recv(socket, buffer, bufferSize, MSG_DONTWAIT)) < 0)
+  {
+    boost::this_thread::interruption_point();
+    if (errno != EINTR)
+    {
+      if (errno == EWOULDBLOCK || errno == EAGAIN) return 0;
+      else
+        throw NetworkSystemError(errno);
+    }
+  }
+  
+  boost::this_thread::interruption_point();
+  if (!result) throw EndOfStream();
+  
+  return result;
+}
+
+size_t TCPSocket::WriteNonBlocking(const char* buffer, size_t bufferLen)
+{
+  if (tls.get()) return 0;
+  
+  ssize_t result;
+  while ((result = send(socket, buffer, bufferLen, MSG_DONTWAIT | MSG_NOSIGNAL)) < 0)
+  {
+    boost::this_thread::interruption_point();
+    if (errno != EINTR)
+    {
+      if (errno == EWOULDBLOCK || errno == EAGAIN) return 0;
+      else
+        throw NetworkSystemError(errno);
+    }
+  }
+  
+  boost::this_thread::interruption_point();
+  return result;
+}
+
+size_t TCPSocket::SendFile(int fd, off_t& offset, size_t count)
+{
+  assert(!tls.get() || tls->KernelSend());
+  
+  ssize_t result;
+  while ((result = sendfile(socket, fd, &offset, count)) < 0)
+  {
+    boost::this_thread::interruption_point();
+    if (errno != EINTR)
+    {
+      if (errno == EWOULDBLOCK || errno == EAGAIN || errno == ETIMEDOUT)
+        throw TimeoutError();
+      else
+        throw NetworkSystemError(errno);
+    }
+  }
+  
+  boost::this_thread::interruption_point();
+  return result;
+}
+
+size_t TCPSocket::Splice(int pipeFd, size_t count)
+{
+  assert(!tls.get());
+  
+  ssize_t result;
+  while ((result = splice(socket, nullptr, pipeFd, nullptr, count, SPLICE_F_MOVE)) < 0)
+  {
+    boost::this_thread::interruption_point();
+    if (errno != EINTR)
+    {
+      if (errno == EWOULDBLOCK || errno == EAGAIN || errno == ETIMEDOUT)
+        throw TimeoutError();
+      else
+        throw NetworkSystemError(errno);
+    }
+  }
+  
+  boost::this_thread::interruption_point();
+  if (!result) throw EndOfStream();
+  
+  return result;
+}
+
+void TCPSocket::SetNonBlocking(bool nonBlocking)
+{
+  int flags = fcntl(socket, F_GETFL);
+  if (flags < 0) throw NetworkSystemError(errno);
+  
+  flags = nonBlocking ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+  if (fcntl(socket, F_SETFL, flags) < 0) throw NetworkSystemError(errno);
+}
+
+void TCPSocket::SetBuffers(int size)
+{
+  // disables the kernel's auto tuning of these buffers and is capped
+  // at net.core.[rw]mem_max, so only done when explicitly asked for
+  setsockopt(socket, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  setsockopt(socket, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+}
+
+long TCPSocket::RoundTripTime() const
+{
+  struct tcp_info info;
+  socklen_t len = sizeof(info);
+  if (getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &len) < 0) return 0;
+  return info.tcpi_rtt;
+}
+
 void TCPSocket::SetTimeout(int socket)
 {
   if (setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout.Timeval(), sizeof(timeout.Timeval())) < 0)
@@ -60,7 +60,11 @@ public:
   void Accept(TCPListener& listener);
   /* Throws NetworkSystemError, InvalidIPAddressError */
   
-  void HandshakeTLS(TLSSocket::HandshakeRole role);
+  void Accept(TCPSocket& pending);
+  /* No exceptions, takes over a connection accepted by another socket */
+  
+  void HandshakeTLS(TLSSocket::HandshakeRole role, const TCPSocket* id = nullptr,
+                    bool kernelOffload = false);
   /* Same as TLSSocket::Handshake() */
   
   size_t Read(char* buffer, size_t bufferSize);
@@ -71,6 +75,20 @@ public:
   /* (No TLS) Throws NetworkSystemError */
   /* (With TLS) Same as TLSSocket::Write() */
   
+  size_t ReadNonBlocking(char* buffer, size_t bufferSize);
+  /* Same as Read(), returns 0 if no data available without blocking */
+  
+  size_t WriteNonBlocking(const char* buffer, size_t bufferLen);
+  /* (No TLS) Throws NetworkSystemError */
+  /* Returns number of bytes written without blocking, always 0 with TLS */
+  
+  size_t SendFile(int fd, off_t& offset, size_t count);
+  /* (No TLS or kernel TLS only) Throws NetworkSystemError */
+  /* Returns 0 when end of file reached */
+  
+  size_t Splice(int pipeFd, size_t count);
+  /* (No TLS only) Throws NetworkSystemError, EndOfStream */
+  
   void Getline(char* buffer, size_t bufferSize, bool stripCRLF = true);
   /* (No TLS) Throws NetworkSystemError, BufferSizeExceeded */
   /* (With TLS) Same as TLSSocket::Read(), BufferSizeExceeded */
@@ -81,6 +99,16 @@ public:
 
   void SetTimeout(const util::TimePair& timeout);
   /* Throws NetworkSystemError */
+  
+  void SetBuffers(int size);
+  /* No exceptions */
+  
+  void SetNonBlocking(bool nonBlocking);
+  /* Throws NetworkSystemError */
+  /* SendFile() and Splice() then throw TimeoutError when they would block */
+  
+  long RoundTripTime() const;
+  /* No exceptions, returns microseconds or 0 if unavailable */
 
   const util::TimePair& Timeout() const { return timeout; }
   
@@ -101,7 +129,13 @@ public:
   
   bool IsConnected() const { return socket >= 0; }
   
+  bool HasBufferedInput() const
+  { return getcharBufferLen > 0 || (tls.get() && tls->HasBufferedInput()); }
+  /* No exceptions */
+  
   bool IsTLS() const { return tls.get() != 0; }
+  bool IsKernelTLSSend() const { return tls.get() && tls->KernelSend(); }
+  bool IsTLSResumed() const { return tls.get() && tls->Resumed(); }
   std::string TLSCipher() const;
 };
 
@@ -1,6 +1,10 @@
 #include <cstdlib>
 #include <cstring>
 #include <cassert>
+#include <algorithm>
+#include <iterator>
+#include <openssl/ec.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include "util/net/tlscontext.hpp"
 #include "util/net/tlserror.hpp"
 #include "util/net/threadid.hpp"
@@ -18,16 +22,29 @@ boost::shared_array<std::mutex> TLSContext::mutexes(new std::mutex[CRYPTO_num_lo
 namespace
 {
 
-RSA* GenerateRSA(int keyLength)
+DH* MakeDH(const unsigned char* p, int pLength, const unsigned char* g, int gLength)
 {
-  return RSA_generate_key(keyLength, RSA_F4, nullptr, nullptr);
-}
+  DH* dh = DH_new();
+  if (!dh) return nullptr;
+  BIGNUM* bnP = BN_bin2bn(p, pLength, nullptr);
+  BIGNUM* bnG = BN_bin2bn(g, gLength, nullptr);
+  
+  // the dh struct is opaque from openssl 1.1 on
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+  if (bnP && bnG && DH_set0_pqg(dh, bnP, nullptr, bnG) == 1) return dh;
+#else
+  if (bnP && bnG)
+  {
+    dh->p = bnP;
+    dh->g = bnG;
+    return dh;
+  }
+#endif
 
-RSA* TempRSACallback(SSL* session, int isExport, int keyLength)
-{
-  if (isExport || keyLength >= 1024) return GenerateRSA(1024);
-  else return GenerateRSA(512);
-  (void) session;
+  if (bnP) BN_free(bnP);
+  if (bnG) BN_free(bnG);
+  DH_free(dh);
+  return nullptr;
 }
 
 DH *GenerateDH512()
@@ -42,16 +59,7 @@ DH *GenerateDH512()
     0xE9,0x2A,0x05,0x5F,
   };
   
-  DH *dh =DH_new();
-  if (!dh) return nullptr;
-  dh->p = BN_bin2bn(dh512p, sizeof(dh512p), nullptr);
-  dh->g = BN_bin2bn(dh512g, sizeof(dh512g), nullptr);
-  if (!dh->p || !dh->g)
-  {
-    DH_free(dh);
-    return nullptr;
-  }
-  return dh;
+  return MakeDH(dh512p, sizeof(dh512p), dh512g, sizeof(dh512g));
 }
 
 DH *GenerateDH1024()
@@ -72,29 +80,78 @@ DH *GenerateDH1024()
     0xA2,0x5E,0xC3,0x55,0xE9,0x2F,0x78,0xC7,
   };
 
-  DH *dh;
-  dh = DH_new();
-  if (!dh) return nullptr;
-  dh->p = BN_bin2bn(dh1024p, sizeof(dh1024p), nullptr);
-  dh->g = BN_bin2bn(dh1024g, sizeof(dh1024g), nullptr);
-  if (!dh->p || !dh->g)
-  {
-    DH_free(dh);
-    return nullptr;
-  }
-  
-  return dh;
+  return MakeDH(dh1024p, sizeof(dh1024p), dh1024g, sizeof(dh1024g));
 }
 
+// openssl copies the parameters returned by the callback
+// so the same ones can be handed out to every handshake
+DH* dh512 = nullptr;
+DH* dh1024 = nullptr;
+
 DH *TempDHCallback(SSL* session, int isExport, int keyLength)
 {
-  if (isExport == 0 || keyLength >= 1024) return GenerateDH1024();
-  else return GenerateDH512();
+  if (isExport == 0 || keyLength >= 1024) return dh1024;
+  else return dh512;
   (void) session;
 }
 
 }
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+const long TLSServerContext::rotateInterval;
+
+// temporary rsa keys are generated ahead of time and replaced
+// periodically by the server context's rotation thread, the previous
+// keys are kept around for a rotation in case a handshake has been 
+// handed one and openssl has yet to take its own reference
+class TLSServerContext::TempRSAKeys
+{
+  std::mutex mutex;
+  RSA* current[2];
+  RSA* previous[2];
+  
+  static int Index(int keyLength) { return keyLength >= 1024 ? 1 : 0; }
+  
+  static RSA* Generate(int keyLength)
+  {
+    return RSA_generate_key(keyLength, RSA_F4, nullptr, nullptr);
+  }
+  
+public:
+  TempRSAKeys()
+  {
+    std::fill(std::begin(current), std::end(current), nullptr);
+    std::fill(std::begin(previous), std::end(previous), nullptr);
+  }
+  
+  ~TempRSAKeys()
+  {
+    for (RSA* rsa : current) if (rsa) RSA_free(rsa);
+    for (RSA* rsa : previous) if (rsa) RSA_free(rsa);
+  }
+  
+  void Rotate()
+  {
+    // generated outside the lock so handshakes aren't held up
+    RSA* rsa512 = Generate(512);
+    RSA* rsa1024 = Generate(1024);
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    for (RSA* rsa : previous) if (rsa) RSA_free(rsa);
+    std::copy(std::begin(current), std::end(current), std::begin(previous));
+    if (rsa512) current[0] = rsa512;
+    if (rsa1024) current[1] = rsa1024;
+  }
+  
+  RSA* Get(int keyLength)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    RSA* rsa = current[Index(keyLength)];
+    return rsa ? rsa : previous[Index(keyLength)];
+  }
+};
+#endif
+
 TLSContext::~TLSContext()
 {
   if (context) SSL_CTX_free(context);
@@ -150,7 +207,6 @@ void TLSContext::LoadCertificate()
         SSL_CTX_check_private_key(context) != 1) throw TLSProtocolError();
   }
   
-  SSL_CTX_set_tmp_rsa_callback(context, TempRSACallback);
 }
 
 void TLSContext::SelectCiphers()
@@ -216,12 +272,22 @@ TLSServerContext::TLSServerContext(const std::string& certificate,
 {
 }
 
+TLSServerContext::~TLSServerContext()
+{
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+  // the keys are members so they outlive the thread rotating them
+  rotateThread.interrupt();
+  if (rotateThread.joinable()) rotateThread.join();
+#endif
+}
+
 void TLSServerContext::CreateContext()
 {
   context = SSL_CTX_new(SSLv23_server_method());
   if (!context) throw TLSProtocolError();
 
-  unsigned long options = SSL_OP_NO_SSLv2 | SSL_OP_ALL;
+  unsigned long options = SSL_OP_NO_SSLv2 | SSL_OP_ALL | 
+                          SSL_OP_SINGLE_DH_USE | SSL_OP_SINGLE_ECDH_USE;
 #if (OPENSSL_VERSION_NUMBER >= 0x10000000)
   options |= SSL_OP_NO_COMPRESSION;
 #endif  
@@ -245,6 +311,16 @@ void TLSServerContext::Initialise(const std::string& certificate,
   }
 }
 
+void TLSServerContext::InitialiseSessionCaching()
+{
+  // session tickets are enabled by default, sessions resumed either way
+  // are restricted to the control connection they were negotiated on
+  // by the session id context set in TLSSocket::Handshake
+  SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_sess_set_cache_size(context, sessionCacheSize);
+  SSL_CTX_set_timeout(context, sessionTimeout);
+}
+
 void TLSServerContext::InitialiseDHKeyExchange()
 {
   // if this fails, ciphers requiring DH key exchange
@@ -280,9 +356,58 @@ void TLSServerContext::InitialiseDHKeyExchange()
 finish:
   if (dh) DH_free(dh);
   if (bio) BIO_free(bio);
-  if (failed) SSL_CTX_set_tmp_dh_callback(context, TempDHCallback);
+  if (failed)
+  {
+    if (!dh512) dh512 = GenerateDH512();
+    if (!dh1024) dh1024 = GenerateDH1024();
+    SSL_CTX_set_tmp_dh_callback(context, TempDHCallback);
+  }
 }
 
+void TLSServerContext::InitialiseECDHKeyExchange()
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+  SSL_CTX_set_ecdh_auto(context, 1);
+#elif !defined(OPENSSL_NO_ECDH)
+  EC_KEY* ecdh = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+  if (ecdh)
+  {
+    SSL_CTX_set_tmp_ecdh(context, ecdh);
+    EC_KEY_free(ecdh);
+  }
+#endif
+}
+
+void TLSServerContext::InitialiseTempRSA()
+{
+  // openssl 1.1 dropped export ciphers along with the temporary rsa
+  // callback, so there's nothing to generate keys for
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+  tempRSAKeys.reset(new TempRSAKeys());
+  tempRSAKeys->Rotate();
+  SSL_CTX_set_tmp_rsa_callback(context, TempRSACallback);
+  rotateThread = boost::thread(&TLSServerContext::RotateTempRSA, this);
+#endif
+}
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+void TLSServerContext::RotateTempRSA()
+{
+  while (true)
+  {
+    boost::this_thread::sleep(boost::posix_time::seconds(rotateInterval));
+    tempRSAKeys->Rotate();
+  }
+}
+
+RSA* TLSServerContext::TempRSACallback(SSL* session, int isExport, int keyLength)
+{
+  if (isExport || keyLength >= 1024) return server->tempRSAKeys->Get(1024);
+  else return server->tempRSAKeys->Get(512);
+  (void) session;
+}
+#endif
+
 SSL_CTX* TLSServerContext::Get()
 {
   if (!server.get()) return nullptr;
@@ -290,5 +415,17 @@ SSL_CTX* TLSServerContext::Get()
   return server->context;
 }
 
+long TLSServerContext::Handshakes()
+{
+  if (!server.get()) return 0;
+  return SSL_CTX_sess_accept_good(server->context);
+}
+
+long TLSServerContext::Resumptions()
+{
+  if (!server.get()) return 0;
+  return SSL_CTX_sess_hits(server->context);
+}
+
 } /* net namespace */
 } /* util namespace */
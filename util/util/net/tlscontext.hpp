@@ -10,6 +10,7 @@
 #include <openssl/rsa.h>
 #include <mutex>
 #include <boost/shared_array.hpp>
+#include <boost/thread/thread.hpp>
 
 namespace util { namespace net
 {
@@ -73,21 +74,48 @@ class TLSServerContext : public TLSContext
   TLSServerContext(const std::string& certificate,
                    const std::string& ciphers);
 
+  static const long sessionCacheSize = 20480;
+  static const long sessionTimeout = 3600; // seconds
+  
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+  class TempRSAKeys;
+
+  static const long rotateInterval = 3600; // seconds
+  
+  std::unique_ptr<TempRSAKeys> tempRSAKeys;
+  boost::thread rotateThread;
+#endif
+
   void CreateContext();
-  void InitialiseSessionCaching() { }
+  void InitialiseSessionCaching();
   void InitialiseDHKeyExchange();
+  void InitialiseECDHKeyExchange();
+  void InitialiseTempRSA();
   void DerivedInitialise()
   {
     InitialiseSessionCaching();
     InitialiseDHKeyExchange();
+    InitialiseECDHKeyExchange();
+    InitialiseTempRSA();
   }
   
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+  void RotateTempRSA();
+  
+  static RSA* TempRSACallback(SSL* session, int isExport, int keyLength);
+#endif
+  
 public:
+  ~TLSServerContext();
+
   static void Initialise(const std::string& certificate,
                          const std::string& ciphers = "");
   /* Throws TLSError, TLSProtocolError */
 
   static SSL_CTX* Get();
+  
+  static long Handshakes();
+  static long Resumptions();
 };
 
 } /* net namespace */
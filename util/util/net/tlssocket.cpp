@@ -1,4 +1,6 @@
+#include <atomic>
 #include <boost/thread/thread.hpp>
+#include <boost/lexical_cast.hpp>
 #include "util/net/tlssocket.hpp"
 #include "util/net/tcpsocket.hpp"
 #include "util/net/tlserror.hpp"
@@ -9,6 +11,11 @@
 namespace util { namespace net
 {
 
+namespace
+{
+std::atomic<unsigned long long> nextSessionContext(0);
+}
+
 TLSSocket::~TLSSocket()
 {
   Close();
@@ -19,10 +26,11 @@ TLSSocket::TLSSocket() :
 {
 }
 
-TLSSocket::TLSSocket(TCPSocket& socket, HandshakeRole role, TLSSocket* id) :
+TLSSocket::TLSSocket(TCPSocket& socket, HandshakeRole role, TLSSocket* id,
+                     bool kernelOffload) :
   session(nullptr)
 {
-  Handshake(socket, role, id);
+  Handshake(socket, role, id, kernelOffload);
 }
 
 void TLSSocket::EvaluateResult(int result)
@@ -62,7 +70,8 @@ void TLSSocket::EvaluateResult(int result)
   }
 }
 
-void TLSSocket::Handshake(TCPSocket& socket, HandshakeRole role, TLSSocket* id)
+void TLSSocket::Handshake(TCPSocket& socket, HandshakeRole role, TLSSocket* id,
+                          bool kernelOffload)
 {
 
   SSL_CTX* ctx = role == Client ?
@@ -76,8 +85,27 @@ void TLSSocket::Handshake(TCPSocket& socket, HandshakeRole role, TLSSocket* id)
   
   if (SSL_set_fd(session, socket.Socket()) != 1) throw TLSProtocolError();
   
+  if (role == Server)
+  {
+    // sessions can only be resumed by connections sharing the same 
+    // context, so data connections inherit their control connection's
+    if (id) sessionContext = id->sessionContext;
+    else sessionContext = boost::lexical_cast<std::string>(++nextSessionContext);
+    if (SSL_set_session_id_context(session, 
+            reinterpret_cast<const unsigned char*>(sessionContext.data()),
+            sessionContext.length()) != 1) throw TLSProtocolError();
+  }
+  else
   if (id) SSL_copy_session_id(session, id->session);
   
+#ifdef SSL_OP_ENABLE_KTLS
+  // openssl only hands the record layer over to the kernel
+  // if the negotiated cipher and the kernel both support it
+  if (kernelOffload) SSL_set_options(session, SSL_OP_ENABLE_KTLS);
+#else
+  (void) kernelOffload;
+#endif
+  
   if (role == Client) SSL_set_connect_state(session);
   else SSL_set_accept_state(session);
 
@@ -125,6 +153,15 @@ void TLSSocket::Close()
   }
 }
 
+bool TLSSocket::KernelSend() const
+{
+#ifdef SSL_OP_ENABLE_KTLS
+  return session && BIO_get_ktls_send(SSL_get_wbio(session));
+#else
+  return false;
+#endif
+}
+
 std::string TLSSocket::Cipher() const
 {
   if (!session) return "NONE";
@@ -2,6 +2,7 @@
 #define __UTIL_NET_TLSSOCKET_HPP
 
 #include <cstdint>
+#include <string>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <boost/noncopyable.hpp>
@@ -14,6 +15,7 @@ class TCPSocket;
 class TLSSocket : private boost::noncopyable
 {
   SSL* session;
+  std::string sessionContext;
 
   void EvaluateResult(int result);  
   
@@ -29,10 +31,12 @@ public:
   TLSSocket();
   /* No exceptions */
   
-  TLSSocket(TCPSocket& socket, HandshakeRole role, TLSSocket* id = 0);
+  TLSSocket(TCPSocket& socket, HandshakeRole role, TLSSocket* id = 0,
+            bool kernelOffload = false);
   /* Throws TLSError, TLSProtocolError, TLSSystemError, EndOfStream */
   
-  void Handshake(TCPSocket& socket, HandshakeRole role, TLSSocket* id = 0);
+  void Handshake(TCPSocket& socket, HandshakeRole role, TLSSocket* id = 0,
+                 bool kernelOffload = false);
   /* Throws TLSError, TLSProtocolError, TLSSystemError, EndOfStream */
   
   size_t Read(char* buffer, size_t bufferSize);
@@ -44,6 +48,16 @@ public:
   /* No exceptions */
   
   std::string Cipher() const;
+  
+  bool HasBufferedInput() const
+  { return session && SSL_pending(session) > 0; }
+  /* No exceptions */
+  
+  bool KernelSend() const;
+  /* No exceptions */
+  
+  bool Resumed() const { return session && SSL_session_reused(session); }
+  /* No exceptions */
 };
 
 } /* net namespace */
@@ -0,0 +1,19 @@
+#ifndef __UTIL_PCLMUL_HPP
+#define __UTIL_PCLMUL_HPP
+
+#include <cstdint>
+#include <sys/types.h>
+
+namespace util { namespace pclmul
+{
+
+bool Supported();
+/* True if the cpu has pclmulqdq and sse4.1, checked with cpuid */
+
+uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc);
+/* Same result as sliceby8::crc32, only call if Supported() */
+
+} /* pclmul namespace */
+} /* util namespace */
+
+#endif